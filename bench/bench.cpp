@@ -0,0 +1,284 @@
+#include <benchmark/benchmark.h>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <stdexcept>
+#include <tuple>
+#include <vector>
+#include "bitReader.h"
+#include "color.h"
+#include "cons.h"
+#include "decoder.h"
+#include "entropy.h"
+#include "huffman.h"
+#include "idct.h"
+#include "syntheticJPEG.h"
+
+namespace {
+
+constexpr size_t kBlockCount = 4096;
+
+constexpr size_t kRowWidth = 1920;
+
+// Grayscale image, so the entropy-coded segment is a plain sequence of luma blocks.
+const std::vector<uint8_t>& GrayImage() {
+    static const std::vector<uint8_t> data = [] {
+        SyntheticImage image;
+        image.components = 1;
+        return EncodeSyntheticJPEG(image);
+    }();
+    return data;
+}
+
+size_t GrayBlockCount() {
+    SyntheticImage image;
+    return (image.width / kStandartMCUSize) * (image.height / kStandartMCUSize);
+}
+
+// Returns the entropy-coded data of the only scan of |data|, EOI included.
+std::vector<uint8_t> EntropySegment(const std::vector<uint8_t>& data) {
+    for (size_t i = 0; i + 3 < data.size(); ++i) {
+        if (data[i] == 0xff && data[i + 1] == static_cast<uint8_t>(kMarkerSOS)) {
+            size_t length = (data[i + 2] << kByteSize) | data[i + 3];
+            return std::vector<uint8_t>(data.begin() + i + 2 + length, data.end());
+        }
+    }
+    throw std::runtime_error("No scans\n");
+}
+
+HuffmanTree StandardTree(StandardTable table) {
+    std::vector<uint8_t> code_lengths;
+    std::vector<uint8_t> values;
+    GetStandardTable(table, code_lengths, values);
+    HuffmanTree tree;
+    tree.Build(code_lengths, values);
+    return tree;
+}
+
+void BM_BitReader(benchmark::State& state) {
+    std::vector<uint8_t> segment = EntropySegment(GrayImage());
+    size_t bits = static_cast<size_t>(state.range(0));
+    size_t count = (segment.size() - 2) * kByteSize / bits;
+    for (auto _ : state) {
+        BitReader reader(segment.data(), segment.size());
+        uint32_t sum = 0;
+        for (size_t i = 0; i < count; ++i) {
+            sum += reader.GetBits(bits);
+        }
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetBytesProcessed(state.iterations() * segment.size());
+}
+BENCHMARK(BM_BitReader)->Arg(1)->Arg(5)->Arg(11);
+
+void BM_Huffman(benchmark::State& state) {
+    std::vector<uint8_t> segment = EntropySegment(GrayImage());
+    HuffmanTree dc = StandardTree(StandardTable::kDCLuminance);
+    HuffmanTree ac = StandardTree(StandardTable::kACLuminance);
+    size_t blocks = GrayBlockCount();
+    size_t symbols = 0;
+    for (auto _ : state) {
+        BitReader reader(segment.data(), segment.size());
+        int32_t value = 0;
+        int32_t sum = 0;
+        symbols = 0;
+        for (size_t i = 0; i < blocks; ++i) {
+            ReadCoef(reader, dc, value);
+            sum += value;
+            for (size_t k = 1; k < kTableSize; ++k, ++symbols) {
+                uint8_t symbol = ReadCoef(reader, ac, value);
+                if (symbol == 0) {
+                    break;
+                }
+                k += symbol >> (kByteSize / 2);
+                sum += value;
+            }
+        }
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetItemsProcessed(state.iterations() * (symbols + blocks));
+}
+BENCHMARK(BM_Huffman);
+
+void BM_DecodeTable(benchmark::State& state) {
+    std::vector<uint8_t> segment = EntropySegment(GrayImage());
+    HuffmanTree dc = StandardTree(StandardTable::kDCLuminance);
+    HuffmanTree ac = StandardTree(StandardTable::kACLuminance);
+    size_t blocks = GrayBlockCount();
+    for (auto _ : state) {
+        BitReader reader(segment.data(), segment.size());
+        int32_t last_value = 0;
+        for (size_t i = 0; i < blocks; ++i) {
+            std::array<int16_t, kTableSize> table{};
+            ReadBlock(reader, dc, ac, last_value, table.data(), nullptr);
+            benchmark::DoNotOptimize(table.data());
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * blocks);
+}
+BENCHMARK(BM_DecodeTable);
+
+void RunIDCT(benchmark::State& state, IDCTMethod method, IDCTFunction idct) {
+    std::vector<int16_t> blocks = SyntheticBlocks(kBlockCount, 85);
+    IDCTTable table;
+    PrepareIDCTTable(method, SyntheticQuantTable(85), table);
+    std::array<uint8_t, kTableSize> output;
+    for (auto _ : state) {
+        for (size_t i = 0; i < kBlockCount; ++i) {
+            idct(blocks.data() + i * kTableSize, table, output.data(), kStandartMCUSize);
+        }
+        benchmark::DoNotOptimize(output.data());
+    }
+    state.SetItemsProcessed(state.iterations() * kBlockCount);
+}
+
+void BM_IDCTIslow(benchmark::State& state) {
+    RunIDCT(state, IDCTMethod::kIslow, IDCTIslow);
+}
+BENCHMARK(BM_IDCTIslow);
+
+void BM_IDCTIfast(benchmark::State& state) {
+    RunIDCT(state, IDCTMethod::kIfast, IDCTIfast);
+}
+BENCHMARK(BM_IDCTIfast);
+
+void BM_IDCTFloat(benchmark::State& state) {
+    RunIDCT(state, IDCTMethod::kFloat, IDCTFloat);
+}
+BENCHMARK(BM_IDCTFloat);
+
+void BM_IDCTFastest(benchmark::State& state) {
+    RunIDCT(state, IDCTMethod::kIslow, GetIDCT(IDCTMethod::kIslow));
+}
+BENCHMARK(BM_IDCTFastest);
+
+// Sparse kernels read only the coefficients they expect to be nonzero.
+void BM_IDCTLowFrequency(benchmark::State& state) {
+    RunIDCT(state, IDCTMethod::kIslow, GetLowIDCT(IDCTMethod::kIslow));
+}
+BENCHMARK(BM_IDCTLowFrequency);
+
+void BM_IDCTDCOnly(benchmark::State& state) {
+    RunIDCT(state, IDCTMethod::kIslow, GetDCIDCT(IDCTMethod::kIslow));
+}
+BENCHMARK(BM_IDCTDCOnly);
+
+void BM_IDCTReduced4x4(benchmark::State& state) {
+    RunIDCT(state, IDCTMethod::kIslow, IDCTReduced4x4);
+}
+BENCHMARK(BM_IDCTReduced4x4);
+
+void RunColorConverter(benchmark::State& state, PixelFormat format, ColorConverter converter) {
+    std::vector<uint8_t> y(kRowWidth);
+    std::vector<uint8_t> cb(kRowWidth);
+    std::vector<uint8_t> cr(kRowWidth);
+    for (size_t i = 0; i < kRowWidth; ++i) {
+        y[i] = static_cast<uint8_t>(i * 7);
+        cb[i] = static_cast<uint8_t>(i * 3 + 64);
+        cr[i] = static_cast<uint8_t>(255 - i * 5);
+    }
+    std::vector<uint8_t> output(kRowWidth * BytesPerPixel(format));
+    for (auto _ : state) {
+        converter(y.data(), cb.data(), cr.data(), output.data(), kRowWidth);
+        benchmark::DoNotOptimize(output.data());
+    }
+    state.SetItemsProcessed(state.iterations() * kRowWidth);
+}
+
+void BM_YCbCrToRGB8(benchmark::State& state) {
+    RunColorConverter(state, PixelFormat::kRGB8, YCbCrToRGB8);
+}
+BENCHMARK(BM_YCbCrToRGB8);
+
+void BM_YCbCrToRGBA8(benchmark::State& state) {
+    RunColorConverter(state, PixelFormat::kRGBA8, YCbCrToRGBA8);
+}
+BENCHMARK(BM_YCbCrToRGBA8);
+
+void BM_YCbCrToRGB8Fastest(benchmark::State& state) {
+    RunColorConverter(state, PixelFormat::kRGB8, GetColorConverter(PixelFormat::kRGB8));
+}
+BENCHMARK(BM_YCbCrToRGB8Fastest);
+
+void BM_YCbCrToRGBA8Fastest(benchmark::State& state) {
+    RunColorConverter(state, PixelFormat::kRGBA8, GetColorConverter(PixelFormat::kRGBA8));
+}
+BENCHMARK(BM_YCbCrToRGBA8Fastest);
+
+void BM_GrayToRGB8Fastest(benchmark::State& state) {
+    RunColorConverter(state, PixelFormat::kRGB8, GetGrayConverter(PixelFormat::kRGB8));
+}
+BENCHMARK(BM_GrayToRGB8Fastest);
+
+void BM_GrayToRGBA8Fastest(benchmark::State& state) {
+    RunColorConverter(state, PixelFormat::kRGBA8, GetGrayConverter(PixelFormat::kRGBA8));
+}
+BENCHMARK(BM_GrayToRGBA8Fastest);
+
+// Arguments are size of the square image, luma sampling factors (0 for grayscale) and the
+// number of threads.
+void BM_Decode(benchmark::State& state) {
+    static std::map<std::tuple<int64_t, int64_t, int64_t, int64_t>, std::vector<uint8_t>> images;
+    SyntheticImage image;
+    image.width = image.height = static_cast<size_t>(state.range(0));
+    image.components = state.range(1) == 0 ? 1 : kChannelNum;
+    image.horizontal = static_cast<uint8_t>(state.range(1) == 0 ? 1 : state.range(1));
+    image.vertical = static_cast<uint8_t>(state.range(2) == 0 ? 1 : state.range(2));
+    image.restart_interval = state.range(3) > 1 ? 16 : 0;
+    auto key = std::make_tuple(state.range(0), state.range(1), state.range(2), state.range(3));
+    auto it = images.find(key);
+    if (it == images.end()) {
+        it = images.emplace(key, EncodeSyntheticJPEG(image)).first;
+    }
+    const std::vector<uint8_t>& data = it->second;
+
+    DecodeOptions options;
+    options.threads = static_cast<size_t>(state.range(3));
+    for (auto _ : state) {
+        Image result = Decode(data.data(), data.size(), options);
+        benchmark::DoNotOptimize(result.Data());
+    }
+    state.SetItemsProcessed(state.iterations() * image.width * image.height);
+    state.SetBytesProcessed(state.iterations() * data.size());
+}
+BENCHMARK(BM_Decode)
+    ->ArgNames({"size", "h", "v", "threads"})
+    ->ArgsProduct({{64, 512, 2048}, {1}, {1}, {1}})
+    ->ArgsProduct({{64, 512, 2048}, {2}, {1, 2}, {1}})
+    ->ArgsProduct({{64, 512, 2048}, {0}, {0}, {1}})
+    ->Args({2048, 2, 2, 4});
+
+// 4:2:0 image without restart markers, entropy decoding overlaps with the other stages.
+void BM_DecodePipelined(benchmark::State& state) {
+    SyntheticImage image;
+    image.width = image.height = 2048;
+    static const std::vector<uint8_t> data = EncodeSyntheticJPEG(image);
+    DecodeOptions options;
+    options.threads = static_cast<size_t>(state.range(0));
+    for (auto _ : state) {
+        Image result = Decode(data.data(), data.size(), options);
+        benchmark::DoNotOptimize(result.Data());
+    }
+    state.SetItemsProcessed(state.iterations() * image.width * image.height);
+    state.SetBytesProcessed(state.iterations() * data.size());
+}
+BENCHMARK(BM_DecodePipelined)->ArgName("threads")->Arg(1)->Arg(2)->Arg(4);
+
+// Default 4:2:0 image of BM_Decode decoded to planes.
+void BM_DecodeYCbCr(benchmark::State& state) {
+    SyntheticImage image;
+    image.width = image.height = static_cast<size_t>(state.range(0));
+    std::vector<uint8_t> data = EncodeSyntheticJPEG(image);
+    for (auto _ : state) {
+        PlanarImage result = DecodeYCbCr(data.data(), data.size());
+        benchmark::DoNotOptimize(result.Data(0));
+    }
+    state.SetItemsProcessed(state.iterations() * image.width * image.height);
+    state.SetBytesProcessed(state.iterations() * data.size());
+}
+BENCHMARK(BM_DecodeYCbCr)->ArgName("size")->Arg(512)->Arg(2048);
+
+}  // namespace
+
+BENCHMARK_MAIN();
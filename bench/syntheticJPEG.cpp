@@ -0,0 +1,723 @@
+#include "syntheticJPEG.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+#include "cons.h"
+
+namespace {
+
+constexpr size_t kSize = 8;
+
+// Tables of Annex K, quantization tables in zigzag order.
+constexpr std::array<uint8_t, kTableSize> kLuminanceQuant = {
+    16, 11, 12, 14, 12,  10,  16, 14,  13, 14,  18, 17,  16, 19, 24, 40,
+    26, 24, 22, 22, 24,  49,  35, 37,  29, 40,  58, 51,  61, 60, 57, 51,
+    56, 55, 64, 72, 92,  78,  64, 68,  87, 69,  55, 56,  80, 109, 81, 87,
+    95, 98, 103, 104, 103, 62, 77, 113, 121, 112, 100, 120, 92, 101, 103, 99};
+
+constexpr std::array<uint8_t, kTableSize> kChrominanceQuant = {
+    17, 18, 18, 24, 21, 24, 47, 26, 26, 47, 99, 66, 56, 66, 99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99};
+
+constexpr std::array<uint8_t, kHuffmanSize> kDCLuminanceBits = {0, 1, 5, 1, 1, 1, 1, 1,
+                                                                1, 0, 0, 0, 0, 0, 0, 0};
+
+constexpr std::array<uint8_t, kHuffmanSize> kDCChrominanceBits = {0, 3, 1, 1, 1, 1, 1, 1,
+                                                                  1, 1, 1, 0, 0, 0, 0, 0};
+
+constexpr std::array<uint8_t, 12> kDCValues = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+
+constexpr std::array<uint8_t, kHuffmanSize> kACLuminanceBits = {0, 2, 1, 3, 3, 2, 4, 3,
+                                                                5, 5, 4, 4, 0, 0, 1, 125};
+
+constexpr std::array<uint8_t, 162> kACLuminanceValues = {
+    0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61,
+    0x07, 0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52,
+    0xd1, 0xf0, 0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25,
+    0x26, 0x27, 0x28, 0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45,
+    0x46, 0x47, 0x48, 0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64,
+    0x65, 0x66, 0x67, 0x68, 0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83,
+    0x84, 0x85, 0x86, 0x87, 0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99,
+    0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6,
+    0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3,
+    0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8,
+    0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa};
+
+constexpr std::array<uint8_t, kHuffmanSize> kACChrominanceBits = {0, 2, 1, 2, 4, 4, 3, 4,
+                                                                  7, 5, 4, 4, 0, 1, 2, 119};
+
+constexpr std::array<uint8_t, 162> kACChrominanceValues = {
+    0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61,
+    0x71, 0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33,
+    0x52, 0xf0, 0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18,
+    0x19, 0x1a, 0x26, 0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44,
+    0x45, 0x46, 0x47, 0x48, 0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63,
+    0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a,
+    0x82, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97,
+    0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4,
+    0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca,
+    0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7,
+    0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa};
+
+// Code and its length for every symbol of a table.
+struct HuffmanCodes {
+    std::array<uint16_t, 256> code{};
+    std::array<uint8_t, 256> length{};
+};
+
+// Table with 8 bits codes for all symbols but 0xff, which gets 9 bits since a code of all ones
+// is not allowed. AC scans of progressive images use it: the tables of Annex K have no
+// symbols for runs of empty blocks.
+void GetFlatTable(std::vector<uint8_t>& code_lengths, std::vector<uint8_t>& values) {
+    code_lengths.assign(kHuffmanSize, 0);
+    code_lengths[7] = 255;
+    code_lengths[8] = 1;
+    values.resize(256);
+    for (size_t i = 0; i < values.size(); ++i) {
+        values[i] = static_cast<uint8_t>(i);
+    }
+}
+
+HuffmanCodes MakeCodes(const std::vector<uint8_t>& code_lengths,
+                       const std::vector<uint8_t>& values) {
+    HuffmanCodes codes;
+    uint16_t code = 0;
+    size_t k = 0;
+    for (size_t length = 1; length <= kHuffmanSize; ++length) {
+        for (size_t i = 0; i < code_lengths[length - 1]; ++i, ++k, ++code) {
+            codes.code[values[k]] = code;
+            codes.length[values[k]] = static_cast<uint8_t>(length);
+        }
+        code <<= 1;
+    }
+    return codes;
+}
+
+HuffmanCodes MakeCodes(StandardTable table) {
+    std::vector<uint8_t> code_lengths;
+    std::vector<uint8_t> values;
+    GetStandardTable(table, code_lengths, values);
+    return MakeCodes(code_lengths, values);
+}
+
+// Quantization table of |quality| in zigzag order, scaled as libjpeg does.
+std::array<uint8_t, kTableSize> ScaleQuant(const std::array<uint8_t, kTableSize>& base,
+                                           int quality) {
+    quality = std::clamp(quality, 1, 100);
+    int scale = quality < 50 ? 5000 / quality : 200 - quality * 2;
+    std::array<uint8_t, kTableSize> table;
+    for (size_t i = 0; i < kTableSize; ++i) {
+        table[i] = static_cast<uint8_t>(std::clamp((base[i] * scale + 50) / 100, 1, 255));
+    }
+    return table;
+}
+
+// Deterministic picture: smooth gradients, a checkerboard of edges and some noise.
+uint8_t Pixel(size_t x, size_t y, size_t channel) {
+    uint32_t hash = static_cast<uint32_t>(x * 73856093u ^ y * 19349663u ^ channel * 83492791u);
+    hash = (hash ^ (hash >> 13)) * 0x5bd1e995u;
+    double value = 128 + 60 * std::sin(x * 0.02 + channel) * std::cos(y * 0.03 - channel) +
+                   (((x / 16 + y / 16) % 2 == 0) ? 30 : -30) + static_cast<int>(hash >> 28) - 8;
+    return static_cast<uint8_t>(std::clamp(value, 0.0, 255.0));
+}
+
+void RGBToYCbCr(uint8_t r, uint8_t g, uint8_t b, std::array<double, 3>& ycc) {
+    ycc[0] = 0.299 * r + 0.587 * g + 0.114 * b;
+    ycc[1] = 128 - 0.168736 * r - 0.331264 * g + 0.5 * b;
+    ycc[2] = 128 + 0.5 * r - 0.418688 * g - 0.081312 * b;
+}
+
+// Forward DCT of 8x8 |samples| quantized by |quant| in zigzag order, result in natural order.
+void ForwardDCT(const double* samples, const std::array<uint8_t, kTableSize>& quant,
+                int16_t* coef) {
+    static const std::array<double, kSize * kSize> kCos = [] {
+        std::array<double, kSize * kSize> table{};
+        for (size_t u = 0; u < kSize; ++u) {
+            for (size_t x = 0; x < kSize; ++x) {
+                double scale = u == 0 ? std::sqrt(0.125) : 0.5;
+                table[u * kSize + x] = scale * std::cos((2 * x + 1) * u * M_PI / 16);
+            }
+        }
+        return table;
+    }();
+
+    std::array<double, kTableSize> rows{};
+    for (size_t y = 0; y < kSize; ++y) {
+        for (size_t u = 0; u < kSize; ++u) {
+            double sum = 0;
+            for (size_t x = 0; x < kSize; ++x) {
+                sum += kCos[u * kSize + x] * (samples[y * kSize + x] - 128);
+            }
+            rows[y * kSize + u] = sum;
+        }
+    }
+    for (size_t i = 0; i < kTableSize; ++i) {
+        size_t v = kZigZag[i] / kSize;
+        size_t u = kZigZag[i] % kSize;
+        double sum = 0;
+        for (size_t y = 0; y < kSize; ++y) {
+            sum += kCos[v * kSize + y] * rows[y * kSize + u];
+        }
+        coef[kZigZag[i]] = static_cast<int16_t>(std::lround(sum / quant[i]));
+    }
+}
+
+class BitWriter {
+public:
+    explicit BitWriter(std::vector<uint8_t>& output) : output_(output) {
+    }
+
+    void Write(uint32_t bits, size_t count) {
+        for (size_t i = count; i > 0; --i) {
+            buffer_ = static_cast<uint8_t>((buffer_ << 1) | ((bits >> (i - 1)) & 1));
+            if (++size_ == kByteSize) {
+                Put(buffer_);
+            }
+        }
+    }
+
+    // Pads the last byte with ones.
+    void Flush() {
+        while (size_ != 0) {
+            Write(1, 1);
+        }
+    }
+
+private:
+    std::vector<uint8_t>& output_;
+    uint8_t buffer_ = 0;
+    size_t size_ = 0;
+
+    void Put(uint8_t byte) {
+        output_.push_back(byte);
+        if (byte == 0xff) {
+            output_.push_back(0x00);
+        }
+        buffer_ = 0;
+        size_ = 0;
+    }
+};
+
+void EncodeValue(BitWriter& writer, const HuffmanCodes& codes, uint8_t run, int32_t value) {
+    uint32_t magnitude = static_cast<uint32_t>(std::abs(value));
+    uint8_t size = 0;
+    while ((magnitude >> size) != 0) {
+        ++size;
+    }
+    uint8_t symbol = static_cast<uint8_t>((run << (kByteSize / 2)) | size);
+    writer.Write(codes.code[symbol], codes.length[symbol]);
+    if (size != 0) {
+        writer.Write(static_cast<uint32_t>(value < 0 ? value - 1 : value) & ((1u << size) - 1),
+                     size);
+    }
+}
+
+void EncodeBlock(BitWriter& writer, const int16_t* coef, int32_t& last_dc,
+                 const HuffmanCodes& dc, const HuffmanCodes& ac) {
+    EncodeValue(writer, dc, 0, coef[0] - last_dc);
+    last_dc = coef[0];
+
+    uint8_t run = 0;
+    for (size_t i = 1; i < kTableSize; ++i) {
+        int16_t value = coef[kZigZag[i]];
+        if (value == 0) {
+            ++run;
+            continue;
+        }
+        while (run >= 16) {
+            writer.Write(ac.code[0xf0], ac.length[0xf0]);
+            run -= 16;
+        }
+        EncodeValue(writer, ac, run, value);
+        run = 0;
+    }
+    if (run != 0) {
+        writer.Write(ac.code[0x00], ac.length[0x00]);
+    }
+}
+
+// Successive approximation scan of a progressive image, T.81 G.1.2: DC and AC scans, each
+// either the first one for its coefficients or a refinement of them by one bit.
+struct ProgressiveScan {
+    std::vector<size_t> components;
+    size_t start = 0;
+    size_t end = 0;
+    uint8_t high = 0;
+    uint8_t low = 0;
+};
+
+// Encodes the blocks of one progressive scan, keeping the run of empty blocks between them.
+class ProgressiveScanWriter {
+public:
+    ProgressiveScanWriter(BitWriter& writer, const HuffmanCodes& codes,
+                          const ProgressiveScan& scan)
+        : writer_(writer), codes_(codes), scan_(scan) {
+    }
+
+    void EncodeBlock(const int16_t* coef, int32_t& last_dc) {
+        if (scan_.start == 0) {
+            int32_t value = coef[0] >> scan_.low;
+            if (scan_.high == 0) {
+                EncodeValue(writer_, codes_, 0, value - last_dc);
+                last_dc = value;
+            } else {
+                writer_.Write(static_cast<uint32_t>(value) & 1, 1);
+            }
+        } else if (scan_.high == 0) {
+            EncodeACFirst(coef);
+        } else {
+            EncodeACRefine(coef);
+        }
+    }
+
+    // Ends the run of empty blocks before a restart marker or the end of the scan.
+    void Finish() {
+        EmitEOBRun();
+    }
+
+private:
+    static constexpr size_t kMaxEOBRun = 0x7fff;
+
+    BitWriter& writer_;
+    const HuffmanCodes& codes_;
+    const ProgressiveScan& scan_;
+    size_t eob_run_ = 0;
+    // Correction bits of the blocks of the run of empty blocks, they follow its symbol.
+    std::vector<uint8_t> run_corrections_;
+
+    void WriteSymbol(uint8_t symbol) {
+        writer_.Write(codes_.code[symbol], codes_.length[symbol]);
+    }
+
+    void WriteBits(const std::vector<uint8_t>& bits) {
+        for (uint8_t bit : bits) {
+            writer_.Write(bit, 1);
+        }
+    }
+
+    void EmitEOBRun() {
+        if (eob_run_ == 0) {
+            return;
+        }
+        uint8_t size = 0;
+        while ((eob_run_ >> (size + 1)) != 0) {
+            ++size;
+        }
+        WriteSymbol(static_cast<uint8_t>(size << (kByteSize / 2)));
+        writer_.Write(static_cast<uint32_t>(eob_run_) & ((1u << size) - 1), size);
+        WriteBits(run_corrections_);
+        run_corrections_.clear();
+        eob_run_ = 0;
+    }
+
+    void EncodeACFirst(const int16_t* coef) {
+        uint8_t run = 0;
+        for (size_t k = scan_.start; k <= scan_.end; ++k) {
+            int32_t value = coef[kZigZag[k]];
+            int32_t magnitude = std::abs(value) >> scan_.low;
+            if (magnitude == 0) {
+                ++run;
+                continue;
+            }
+            EmitEOBRun();
+            while (run >= 16) {
+                WriteSymbol(0xf0);
+                run -= 16;
+            }
+            EncodeValue(writer_, codes_, run, value < 0 ? -magnitude : magnitude);
+            run = 0;
+        }
+        if (run != 0 && ++eob_run_ == kMaxEOBRun) {
+            EmitEOBRun();
+        }
+    }
+
+    // Coefficients that become nonzero in this scan are coded with their sign, the others
+    // already nonzero get a correction bit each, sent after the next symbol.
+    void EncodeACRefine(const int16_t* coef) {
+        std::array<int32_t, kTableSize> magnitudes{};
+        size_t last_new = 0;
+        for (size_t k = scan_.start; k <= scan_.end; ++k) {
+            magnitudes[k] = std::abs(coef[kZigZag[k]]) >> scan_.low;
+            if (magnitudes[k] == 1) {
+                last_new = k;
+            }
+        }
+
+        std::vector<uint8_t> corrections;
+        uint8_t run = 0;
+        for (size_t k = scan_.start; k <= scan_.end; ++k) {
+            if (magnitudes[k] == 0) {
+                ++run;
+                continue;
+            }
+            while (run >= 16 && k <= last_new) {
+                EmitEOBRun();
+                WriteSymbol(0xf0);
+                WriteBits(corrections);
+                corrections.clear();
+                run -= 16;
+            }
+            if (magnitudes[k] > 1) {
+                corrections.push_back(static_cast<uint8_t>(magnitudes[k] & 1));
+                continue;
+            }
+            EmitEOBRun();
+            WriteSymbol(static_cast<uint8_t>((run << (kByteSize / 2)) | 1));
+            writer_.Write(coef[kZigZag[k]] < 0 ? 0 : 1, 1);
+            WriteBits(corrections);
+            corrections.clear();
+            run = 0;
+        }
+        if (run != 0 || !corrections.empty()) {
+            run_corrections_.insert(run_corrections_.end(), corrections.begin(),
+                                    corrections.end());
+            if (++eob_run_ == kMaxEOBRun) {
+                EmitEOBRun();
+            }
+        }
+    }
+};
+
+void PutMarker(std::vector<uint8_t>& output, MarkerType marker) {
+    output.push_back(static_cast<uint8_t>(marker >> kByteSize));
+    output.push_back(static_cast<uint8_t>(marker));
+}
+
+void PutSegment(std::vector<uint8_t>& output, MarkerType marker,
+                const std::vector<uint8_t>& data) {
+    PutMarker(output, marker);
+    output.push_back(static_cast<uint8_t>((data.size() + 2) >> kByteSize));
+    output.push_back(static_cast<uint8_t>(data.size() + 2));
+    output.insert(output.end(), data.begin(), data.end());
+}
+
+// Quantized blocks of a channel of the generated image.
+struct SyntheticChannel {
+    size_t horizontal = 1;
+    size_t vertical = 1;
+    size_t blocks_width = 0;
+    size_t blocks_hieght = 0;
+    std::vector<int16_t> coef;
+
+    int16_t* Block(size_t row, size_t column) {
+        return coef.data() + (row * blocks_width + column) * kTableSize;
+    }
+};
+
+// Writes the restart marker before the |unit|-th MCU of a scan if it starts an interval.
+bool PutRestart(const SyntheticImage& image, size_t unit, BitWriter& writer,
+                std::vector<uint8_t>& output) {
+    if (image.restart_interval == 0 || unit == 0 || unit % image.restart_interval != 0) {
+        return false;
+    }
+    writer.Flush();
+    PutMarker(output, kMarkerRST0 + (unit / image.restart_interval - 1) % kRestartMarkerNum);
+    return true;
+}
+
+void EncodeBaseline(const SyntheticImage& image, std::array<SyntheticChannel, kChannelNum>& grid,
+                    size_t channels, size_t mcu_columns, size_t mcu_rows,
+                    std::vector<uint8_t>& output) {
+    std::vector<uint8_t> data = {static_cast<uint8_t>(channels)};
+    for (size_t id = 0; id < channels; ++id) {
+        data.push_back(static_cast<uint8_t>(id + 1));
+        data.push_back(id == 0 ? 0x00 : 0x11);
+    }
+    data.insert(data.end(), {0x00, 0x3f, 0x00});
+    PutSegment(output, kMarkerSOS, data);
+
+    std::array<HuffmanCodes, 4> codes = {
+        MakeCodes(StandardTable::kDCLuminance), MakeCodes(StandardTable::kACLuminance),
+        MakeCodes(StandardTable::kDCChrominance), MakeCodes(StandardTable::kACChrominance)};
+    BitWriter writer(output);
+    std::array<int32_t, kChannelNum> last_dc{};
+    for (size_t mcu_count = 0; mcu_count < mcu_rows * mcu_columns; ++mcu_count) {
+        if (PutRestart(image, mcu_count, writer, output)) {
+            last_dc.fill(0);
+        }
+        size_t column = mcu_count % mcu_columns;
+        size_t row = mcu_count / mcu_columns;
+        for (size_t id = 0; id < channels; ++id) {
+            SyntheticChannel& channel = grid[id];
+            for (size_t by = 0; by < channel.vertical; ++by) {
+                for (size_t bx = 0; bx < channel.horizontal; ++bx) {
+                    EncodeBlock(writer,
+                                channel.Block(row * channel.vertical + by,
+                                              column * channel.horizontal + bx),
+                                last_dc[id], codes[id == 0 ? 0 : 2], codes[id == 0 ? 1 : 3]);
+                }
+            }
+        }
+    }
+    writer.Flush();
+}
+
+// Follows the script of jpeg_simple_progression of libjpeg: DC and low AC of luma first,
+// every coefficient is sent in two or three parts.
+std::vector<ProgressiveScan> ProgressiveScript(size_t channels) {
+    if (channels == 1) {
+        return {{{0}, 0, 0, 0, 1},  {{0}, 1, 5, 0, 2},  {{0}, 6, 63, 0, 2},
+                {{0}, 1, 63, 2, 1}, {{0}, 0, 0, 1, 0},  {{0}, 1, 63, 1, 0}};
+    }
+    return {{{0, 1, 2}, 0, 0, 0, 1}, {{0}, 1, 5, 0, 2},       {{2}, 1, 63, 0, 1},
+            {{1}, 1, 63, 0, 1},       {{0}, 6, 63, 0, 2},      {{0}, 1, 63, 2, 1},
+            {{0, 1, 2}, 0, 0, 1, 0}, {{2}, 1, 63, 1, 0},      {{1}, 1, 63, 1, 0},
+            {{0}, 1, 63, 1, 0}};
+}
+
+void EncodeProgressive(const SyntheticImage& image,
+                       std::array<SyntheticChannel, kChannelNum>& grid, size_t channels,
+                       size_t mcu_columns, size_t mcu_rows, std::vector<uint8_t>& output) {
+    std::vector<uint8_t> code_lengths;
+    std::vector<uint8_t> values;
+    GetFlatTable(code_lengths, values);
+    HuffmanCodes ac = MakeCodes(code_lengths, values);
+    HuffmanCodes dc = MakeCodes(StandardTable::kDCLuminance);
+    size_t max_horizontal = grid[0].horizontal;
+    size_t max_vertical = grid[0].vertical;
+
+    for (const ProgressiveScan& scan : ProgressiveScript(channels)) {
+        std::vector<uint8_t> data = {static_cast<uint8_t>(scan.components.size())};
+        for (size_t id : scan.components) {
+            data.push_back(static_cast<uint8_t>(id + 1));
+            data.push_back(0x00);
+        }
+        data.insert(data.end(), {static_cast<uint8_t>(scan.start), static_cast<uint8_t>(scan.end),
+                                 static_cast<uint8_t>((scan.high << (kByteSize / 2)) | scan.low)});
+        PutSegment(output, kMarkerSOS, data);
+
+        BitWriter writer(output);
+        ProgressiveScanWriter scan_writer(writer, scan.start == 0 ? dc : ac, scan);
+        std::array<int32_t, kChannelNum> last_dc{};
+        auto restart = [&](size_t unit) {
+            scan_writer.Finish();
+            if (PutRestart(image, unit, writer, output)) {
+                last_dc.fill(0);
+            }
+        };
+
+        if (scan.components.size() == 1) {
+            // Non-interleaved scan covers only the blocks inside the channel.
+            size_t id = scan.components[0];
+            SyntheticChannel& channel = grid[id];
+            size_t width = (image.width * channel.horizontal - 1) / max_horizontal / kSize + 1;
+            size_t hieght = (image.height * channel.vertical - 1) / max_vertical / kSize + 1;
+            for (size_t unit = 0; unit < width * hieght; ++unit) {
+                if (image.restart_interval != 0 && unit % image.restart_interval == 0) {
+                    restart(unit);
+                }
+                scan_writer.EncodeBlock(channel.Block(unit / width, unit % width), last_dc[id]);
+            }
+        } else {
+            for (size_t unit = 0; unit < mcu_rows * mcu_columns; ++unit) {
+                if (image.restart_interval != 0 && unit % image.restart_interval == 0) {
+                    restart(unit);
+                }
+                size_t column = unit % mcu_columns;
+                size_t row = unit / mcu_columns;
+                for (size_t id : scan.components) {
+                    SyntheticChannel& channel = grid[id];
+                    for (size_t by = 0; by < channel.vertical; ++by) {
+                        for (size_t bx = 0; bx < channel.horizontal; ++bx) {
+                            scan_writer.EncodeBlock(
+                                channel.Block(row * channel.vertical + by,
+                                              column * channel.horizontal + bx),
+                                last_dc[id]);
+                        }
+                    }
+                }
+            }
+        }
+        scan_writer.Finish();
+        writer.Flush();
+    }
+}
+
+}  // namespace
+
+void GetStandardTable(StandardTable table, std::vector<uint8_t>& code_lengths,
+                      std::vector<uint8_t>& values) {
+    if (table == StandardTable::kDCLuminance) {
+        code_lengths.assign(kDCLuminanceBits.begin(), kDCLuminanceBits.end());
+        values.assign(kDCValues.begin(), kDCValues.end());
+    } else if (table == StandardTable::kDCChrominance) {
+        code_lengths.assign(kDCChrominanceBits.begin(), kDCChrominanceBits.end());
+        values.assign(kDCValues.begin(), kDCValues.end());
+    } else if (table == StandardTable::kACLuminance) {
+        code_lengths.assign(kACLuminanceBits.begin(), kACLuminanceBits.end());
+        values.assign(kACLuminanceValues.begin(), kACLuminanceValues.end());
+    } else {
+        code_lengths.assign(kACChrominanceBits.begin(), kACChrominanceBits.end());
+        values.assign(kACChrominanceValues.begin(), kACChrominanceValues.end());
+    }
+}
+
+std::vector<uint8_t> EncodeSyntheticJPEG(const SyntheticImage& image) {
+    size_t channels = image.components == 1 ? 1 : kChannelNum;
+    uint8_t horizontal = channels == 1 ? 1 : image.horizontal;
+    uint8_t vertical = channels == 1 ? 1 : image.vertical;
+    std::array<std::array<uint8_t, kTableSize>, 2> quant = {
+        ScaleQuant(kLuminanceQuant, image.quality), ScaleQuant(kChrominanceQuant, image.quality)};
+
+    size_t mcu_width = kSize * horizontal;
+    size_t mcu_hieght = kSize * vertical;
+    size_t mcu_columns = (image.width - 1) / mcu_width + 1;
+    size_t mcu_rows = (image.height - 1) / mcu_hieght + 1;
+
+    // Quantized blocks of each channel on the grid of MCU, natural order inside the block.
+    std::array<SyntheticChannel, kChannelNum> grid;
+    for (size_t id = 0; id < channels; ++id) {
+        SyntheticChannel& channel = grid[id];
+        channel.horizontal = id == 0 ? horizontal : 1;
+        channel.vertical = id == 0 ? vertical : 1;
+        channel.blocks_width = mcu_columns * channel.horizontal;
+        channel.blocks_hieght = mcu_rows * channel.vertical;
+        channel.coef.resize(channel.blocks_width * channel.blocks_hieght * kTableSize);
+    }
+
+    std::vector<double> mcu(kChannelNum * mcu_width * mcu_hieght);
+    std::array<double, kTableSize> samples;
+    std::array<double, 3> ycc;
+    for (size_t mcu_count = 0; mcu_count < mcu_rows * mcu_columns; ++mcu_count) {
+        size_t column = mcu_count % mcu_columns;
+        size_t row = mcu_count / mcu_columns;
+        for (size_t y = 0; y < mcu_hieght; ++y) {
+            for (size_t x = 0; x < mcu_width; ++x) {
+                size_t px = std::min(column * mcu_width + x, image.width - 1);
+                size_t py = std::min(row * mcu_hieght + y, image.height - 1);
+                RGBToYCbCr(Pixel(px, py, 0), Pixel(px, py, 1), Pixel(px, py, 2), ycc);
+                for (size_t id = 0; id < kChannelNum; ++id) {
+                    mcu[(id * mcu_hieght + y) * mcu_width + x] = channels == 1 ? ycc[0] : ycc[id];
+                }
+            }
+        }
+
+        for (size_t by = 0; by < vertical; ++by) {
+            for (size_t bx = 0; bx < horizontal; ++bx) {
+                for (size_t y = 0; y < kSize; ++y) {
+                    for (size_t x = 0; x < kSize; ++x) {
+                        samples[y * kSize + x] = mcu[(by * kSize + y) * mcu_width + bx * kSize + x];
+                    }
+                }
+                ForwardDCT(samples.data(), quant[0],
+                           grid[0].Block(row * vertical + by, column * horizontal + bx));
+            }
+        }
+
+        // Chroma blocks average |horizontal| x |vertical| samples.
+        for (size_t id = 1; id < channels; ++id) {
+            for (size_t y = 0; y < kSize; ++y) {
+                for (size_t x = 0; x < kSize; ++x) {
+                    double sum = 0;
+                    for (size_t i = 0; i < vertical; ++i) {
+                        for (size_t j = 0; j < horizontal; ++j) {
+                            sum += mcu[(id * mcu_hieght + y * vertical + i) * mcu_width +
+                                       x * horizontal + j];
+                        }
+                    }
+                    samples[y * kSize + x] = sum / (horizontal * vertical);
+                }
+            }
+            ForwardDCT(samples.data(), quant[1], grid[id].Block(row, column));
+        }
+    }
+
+    std::vector<uint8_t> output;
+    std::vector<uint8_t> data;
+    PutMarker(output, kMarkerStart);
+
+    for (size_t id = 0; id < std::min<size_t>(channels, 2); ++id) {
+        data.assign(1, static_cast<uint8_t>(id));
+        data.insert(data.end(), quant[id].begin(), quant[id].end());
+        PutSegment(output, kMarkerDQT, data);
+    }
+
+    data = {kByteSize,
+            static_cast<uint8_t>(image.height >> kByteSize),
+            static_cast<uint8_t>(image.height),
+            static_cast<uint8_t>(image.width >> kByteSize),
+            static_cast<uint8_t>(image.width),
+            static_cast<uint8_t>(channels)};
+    for (size_t id = 0; id < channels; ++id) {
+        data.push_back(static_cast<uint8_t>(id + 1));
+        data.push_back(id == 0 ? static_cast<uint8_t>((horizontal << (kByteSize / 2)) | vertical)
+                               : 0x11);
+        data.push_back(id == 0 ? 0 : 1);
+    }
+    PutSegment(output, image.progressive ? kMarkerSOF2 : kMarkerSOF0, data);
+
+    std::vector<uint8_t> code_lengths;
+    std::vector<uint8_t> values;
+    if (image.progressive) {
+        for (uint8_t table : {0x00, 0x10}) {
+            if (table == 0x00) {
+                GetStandardTable(StandardTable::kDCLuminance, code_lengths, values);
+            } else {
+                GetFlatTable(code_lengths, values);
+            }
+            data.assign(1, table);
+            data.insert(data.end(), code_lengths.begin(), code_lengths.end());
+            data.insert(data.end(), values.begin(), values.end());
+            PutSegment(output, kMarkerDHT, data);
+        }
+    } else {
+        const std::array<std::pair<StandardTable, uint8_t>, 4> tables = {
+            std::make_pair(StandardTable::kDCLuminance, 0x00),
+            std::make_pair(StandardTable::kACLuminance, 0x10),
+            std::make_pair(StandardTable::kDCChrominance, 0x01),
+            std::make_pair(StandardTable::kACChrominance, 0x11)};
+        for (size_t i = 0; i < (channels == 1 ? 2 : 4); ++i) {
+            GetStandardTable(tables[i].first, code_lengths, values);
+            data.assign(1, tables[i].second);
+            data.insert(data.end(), code_lengths.begin(), code_lengths.end());
+            data.insert(data.end(), values.begin(), values.end());
+            PutSegment(output, kMarkerDHT, data);
+        }
+    }
+
+    if (image.restart_interval != 0) {
+        PutSegment(output, kMarkerDRI,
+                   {static_cast<uint8_t>(image.restart_interval >> kByteSize),
+                    static_cast<uint8_t>(image.restart_interval)});
+    }
+
+    if (image.progressive) {
+        EncodeProgressive(image, grid, channels, mcu_columns, mcu_rows, output);
+    } else {
+        EncodeBaseline(image, grid, channels, mcu_columns, mcu_rows, output);
+    }
+    PutMarker(output, kMarkerEnd);
+    return output;
+}
+
+std::vector<int16_t> SyntheticBlocks(size_t count, int quality) {
+    std::array<uint8_t, kTableSize> quant = ScaleQuant(kLuminanceQuant, quality);
+    std::vector<int16_t> blocks(count * kTableSize);
+    std::array<double, kTableSize> samples;
+    size_t columns = 64;
+    for (size_t i = 0; i < count; ++i) {
+        for (size_t y = 0; y < kSize; ++y) {
+            for (size_t x = 0; x < kSize; ++x) {
+                samples[y * kSize + x] =
+                    Pixel(i % columns * kSize + x, i / columns * kSize + y, 0);
+            }
+        }
+        ForwardDCT(samples.data(), quant, blocks.data() + i * kTableSize);
+    }
+    return blocks;
+}
+
+std::vector<int32_t> SyntheticQuantTable(int quality) {
+    std::array<uint8_t, kTableSize> quant = ScaleQuant(kLuminanceQuant, quality);
+    std::vector<int32_t> table(kTableSize);
+    for (size_t i = 0; i < kTableSize; ++i) {
+        table[kZigZag[i]] = quant[i];
+    }
+    return table;
+}
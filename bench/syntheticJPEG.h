@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Parameters of a generated image. Chroma channels are sampled 1x1, luma
+// |horizontal| x |vertical|.
+struct SyntheticImage {
+    size_t width = 512;
+    size_t height = 512;
+    // 1 for grayscale, 3 for YCbCr.
+    size_t components = 3;
+    uint8_t horizontal = 2;
+    uint8_t vertical = 2;
+    int quality = 85;
+    size_t restart_interval = 0;
+    // Spectral selection and successive approximation scans in the order of libjpeg's
+    // jpeg_simple_progression instead of a single baseline scan.
+    bool progressive = false;
+};
+
+enum class StandardTable {
+    kDCLuminance,
+    kACLuminance,
+    kDCChrominance,
+    kACChrominance,
+};
+
+// Fills DHT contents of the table from Annex K of the standard, used by the encoder.
+void GetStandardTable(StandardTable table, std::vector<uint8_t>& code_lengths,
+                      std::vector<uint8_t>& values);
+
+// Encodes a deterministic picture of gradients, edges and noise with the standard tables.
+std::vector<uint8_t> EncodeSyntheticJPEG(const SyntheticImage& image);
+
+// Returns the quantized blocks of the luma channel of the picture in natural order, as the
+// decoder sees them before dequantization.
+std::vector<int16_t> SyntheticBlocks(size_t count, int quality);
+
+// Returns the luma quantization table of |quality| in natural order.
+std::vector<int32_t> SyntheticQuantTable(int quality);
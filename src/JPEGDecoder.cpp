@@ -1,16 +1,115 @@
 #include "JPEGDecoder.h"
 #include <algorithm>
-#include <cmath>
+#include <array>
+#include <atomic>
 #include <cstddef>
 #include <cstdint>
+#include <future>
+#include <memory>
+#include <mutex>
 #include <stdexcept>
+#include <utility>
 #include <vector>
 #include "cons.h"
 #include <glog/logging.h>
-#include <math.h>
-#include "fft.h"
+#include "color.h"
+#include "entropy.h"
+#include "idct.h"
+#include "rowRing.h"
+#include "threadPool.h"
 
-JPEGDecoder::JPEGDecoder(std::istream& input) : reader_(input), finish_(false) {
+JPEGDecoder::JPEGDecoder(std::istream& input, const DecodeOptions& options)
+    : JPEGDecoder(BitReader(input), options) {
+}
+
+JPEGDecoder::JPEGDecoder(const uint8_t* data, size_t size, const DecodeOptions& options)
+    : JPEGDecoder(BitReader(data, size), options) {
+}
+
+JPEGDecoder::JPEGDecoder(BitReader&& reader, const DecodeOptions& options)
+    : reader_(std::move(reader)) {
+    Init(options);
+}
+
+void JPEGDecoder::SetThreadPool(ThreadPool* pool) {
+    pool_ = pool;
+}
+
+void JPEGDecoder::Reset(BitReader&& reader, const DecodeOptions& options) {
+    reader_ = std::move(reader);
+    tables_.Trim();
+    Init(options);
+}
+
+void JPEGDecoder::Init(const DecodeOptions& options) {
+    if (options.scale != 1 && options.scale != 2 && options.scale != 4 &&
+        options.scale != kStandartMCUSize) {
+        DLOG(ERROR) << "Wrong scale\n";
+        throw std::invalid_argument("Wrong scale\n");
+    }
+
+    finish_ = false;
+    stopped_ = false;
+    idct_method_ = options.scale == 1 ? options.idct_method : IDCTMethod::kIslow;
+    pixel_format_ = options.pixel_format;
+    planar_ = false;
+    color_ = GetColorConverter(options.pixel_format);
+    gray_ = false;
+    threads_ = std::max<size_t>(options.threads, 1);
+    restart_interval_ = 0;
+    scale_ = options.scale;
+    decode_mcu_ = &JPEGDecoder::DecodeMCUBlock;
+    block_size_ = kStandartMCUSize / scale_;
+    width_ = 0;
+    height_ = 0;
+    crop_ = options.crop;
+    crop_offset_ = 0;
+    progressive_ = false;
+    coefficients_only_ = false;
+    incremental_ = false;
+    scanning_ = false;
+    scan_row_ = 0;
+    scan_column_ = 0;
+    scan_columns_ = 0;
+    scan_mcu_ = 0;
+    rows_ready_ = 0;
+    scans_ = 0;
+    max_scans_ = options.max_scans;
+    stats_ = options.stats;
+    if (stats_ != nullptr) {
+        *stats_ = DecodeStats();
+    }
+    image_ = Image();
+    planar_image_ = PlanarImage();
+    header_ = ImageHeader();
+    row_callback_ = nullptr;
+
+    DQT00.clear();
+    DQT01.clear();
+    DQT10.clear();
+    DQT11.clear();
+    DHTAC.fill(nullptr);
+    DHTDC.fill(nullptr);
+
+    // Planes and coefficients keep their memory for the next image.
+    for (size_t id = 0; id < kChannelNum; ++id) {
+        Channel& channel = GetChannelById(id);
+        channel.horizontal = 1;
+        channel.vertical = 1;
+        channel.block_width = block_size_;
+        channel.block_hieght = block_size_;
+        channel.idct = nullptr;
+        channel.dc_idct = nullptr;
+        channel.low_idct = nullptr;
+        channel.DQTid = 0;
+        channel.idct_table = nullptr;
+        channel.DHTAC = nullptr;
+        channel.DHTDC = nullptr;
+        channel.coefficients.clear();
+        channel.coef_width = 0;
+        channel.used_ = false;
+        channel.in_scan = false;
+    }
 }
 
 Channel& JPEGDecoder::GetChannelById(size_t id) {
@@ -22,174 +121,980 @@ Channel& JPEGDecoder::GetChannelById(size_t id) {
     return Cr;
 }
 
-void JPEGDecoder::Norm(std::vector<int32_t>& table) {
-    for (int32_t& num : table) {
-        num = std::min(255, std::max(0, num + 128));
+void JPEGDecoder::DecodeTable(EntropyState& state, size_t id, uint8_t* output, size_t stride) {
+    const Channel& channel = GetChannelById(id);
+    alignas(16) std::array<int16_t, kTableSize> table{};
+    JPEG_DECODER_STATS_ONLY(StageClock clock(state.stats);)
+
+    // Zigzag position of the last coded coefficient selects the kernel.
+    size_t last = ReadBlock(*state.reader, *channel.DHTDC, *channel.DHTAC, state.last_value[id],
+                            table.data(), state.stats);
+
+    JPEG_DECODER_STATS_ONLY(clock.Lap(&DecodeStats::entropy_ns);)
+    TransformBlock(channel, table.data(), last, output, stride, state.stats);
+    JPEG_DECODER_STATS_ONLY(clock.Lap(&DecodeStats::idct_ns);)
+}
+
+void JPEGDecoder::TransformBlock(const Channel& channel, const int16_t* table, size_t last,
+                                 uint8_t* output, size_t stride,
+                                 [[maybe_unused]] DecodeStats* stats) {
+    if (last == 0) {
+        channel.dc_idct(table, *channel.idct_table, output, stride);
+    } else if (last < kLowFrequencyCount) {
+        channel.low_idct(table, *channel.idct_table, output, stride);
+    } else {
+        channel.idct(table, *channel.idct_table, output, stride);
     }
+    JPEG_DECODER_STATS_ONLY(if (stats != nullptr) {
+        ++stats->idct_blocks;
+        if (last == 0) {
+            ++stats->dc_only_blocks;
+        } else if (last < kLowFrequencyCount) {
+            ++stats->low_frequency_blocks;
+        }
+    })
 }
 
-void JPEGDecoder::IDCT(std::vector<int32_t>& table) {
-    static std::vector<double> input(kTableSize);
-    static std::vector<double> output(kTableSize);
-    static DctCalculator fft(kStandartMCUSize, &input, &output);
-    for (size_t i = 0; i < kTableSize; ++i) {
-        input[i] = static_cast<double>(table[i]);
+void JPEGDecoder::SkipTable(EntropyState& state, size_t id) {
+    const Channel& channel = GetChannelById(id);
+    int32_t value = 0;
+    JPEG_DECODER_STATS_ONLY(StageClock clock(state.stats);)
+
+    ReadCoef(*state.reader, *channel.DHTDC, value);
+    state.last_value[id] += value;
+    JPEG_DECODER_STATS_ONLY(if (state.stats != nullptr) {
+        ++state.stats->blocks;
+    })
+
+    for (size_t i = 1; i < kTableSize; ++i) {
+        uint8_t coef = SkipCoef(*state.reader, *channel.DHTAC);
+
+        if (coef == 0) {
+            break;
+        }
+
+        i += coef >> (kByteSize / 2);
+
+        if (i >= kTableSize) {
+            DLOG(ERROR) << "Wrong coef\n";
+            throw std::runtime_error("Wrong coef\n");
+        }
     }
-    fft.Inverse();
-    for (size_t i = 0; i < kTableSize; ++i) {
-        table[i] = round(output[i]);
+    JPEG_DECODER_STATS_ONLY(clock.Lap(&DecodeStats::entropy_ns);)
+}
+
+void JPEGDecoder::SkipMCUBlock(EntropyState& state, size_t mcu_hieght, size_t mcu_width) {
+    JPEG_DECODER_STATS_ONLY(if (state.stats != nullptr) {
+        ++state.stats->mcus;
+    })
+    for (size_t id = 0; id < kChannelNum; ++id) {
+        const Channel& channel = GetChannelById(id);
+        if (!channel.used_) {
+            continue;
+        }
+        size_t blocks = (mcu_hieght / channel.vertical / channel.block_hieght) *
+                        (mcu_width / channel.horizontal / channel.block_width);
+        for (size_t i = 0; i < blocks; ++i) {
+            SkipTable(state, id);
+        }
     }
 }
 
-void JPEGDecoder::ProductTable(std::vector<int32_t>& lhs, const std::vector<int32_t>& rhs) {
-    for (size_t i = 0; i < std::min(lhs.size(), rhs.size()); ++i) {
-        lhs[i] *= rhs[i];  // TODO: maybe integer overflow
+void JPEGDecoder::DecodeChannel(EntropyState& state, size_t id, size_t row, size_t column,
+                                size_t mcu_hieght, size_t mcu_width) {
+    Channel& channel = GetChannelById(id);
+    size_t hieght = mcu_hieght / channel.vertical;
+    size_t width = mcu_width / channel.horizontal;
+    uint8_t* output = channel.plane.data() + (row * hieght) * channel.plane_width + column * width;
+
+    for (size_t i = 0; i < hieght; i += channel.block_hieght) {
+        for (size_t j = 0; j < width; j += channel.block_width) {
+            DecodeTable(state, id, output + i * channel.plane_width + j, channel.plane_width);
+        }
     }
 }
 
-uint8_t JPEGDecoder::ReadCoef(HuffmanTree* huffman) {
-    int32_t value = 0;
-    while (!huffman->Move(reader_.ReadBit(), value)) {
+void JPEGDecoder::DecodeMCUBlock(EntropyState& state, size_t row, size_t column,
+                                 size_t mcu_hieght, size_t mcu_width) {
+    JPEG_DECODER_STATS_ONLY(if (state.stats != nullptr) {
+        ++state.stats->mcus;
+    })
+    for (size_t id = 0; id < kChannelNum; ++id) {
+        if (GetChannelById(id).used_) {
+            DecodeChannel(state, id, row, column, mcu_hieght, mcu_width);
+        }
     }
-    return static_cast<uint8_t>(value);
 }
 
-int32_t JPEGDecoder::ReadValue(size_t length) {
-    if (length == 0) {  // TODO: maybe 0 is illegal
-        return 0;
+template <size_t kWidth, size_t kHieght, bool kColor>
+void JPEGDecoder::DecodeMCU(EntropyState& state, size_t row, size_t column, size_t, size_t) {
+    JPEG_DECODER_STATS_ONLY(if (state.stats != nullptr) {
+        ++state.stats->mcus;
+    })
+    size_t stride = Y.plane_width;
+    uint8_t* output =
+        Y.plane.data() + (row * kHieght * stride + column * kWidth) * block_size_;
+    for (size_t i = 0; i < kHieght; ++i) {
+        for (size_t j = 0; j < kWidth; ++j) {
+            DecodeTable(state, 0, output + (i * stride + j) * block_size_, stride);
+        }
+    }
+    if (kColor) {
+        stride = Cb.plane_width;
+        size_t offset = row * Cb.block_hieght * stride + column * Cb.block_width;
+        DecodeTable(state, 1, Cb.plane.data() + offset, stride);
+        DecodeTable(state, 2, Cr.plane.data() + offset, stride);
     }
+}
 
-    if (length > 30) {
-        DLOG(ERROR) << "Very big int\n";
-        throw std::runtime_error("Very big int\n");
+JPEGDecoder::MCUDecoder JPEGDecoder::GetMCUDecoder() const {
+    if (!Y.used_ || Y.horizontal != 1 || Y.vertical != 1) {
+        return &JPEGDecoder::DecodeMCUBlock;
+    }
+    if (!Cb.used_ && !Cr.used_) {
+        return &JPEGDecoder::DecodeMCU<1, 1, false>;
     }
+    // Chroma channels with one block in an MCU, their upsampling factors are the numbers of
+    // luma blocks in it.
+    const Sampling& cb = header_.sampling[1];
+    const Sampling& cr = header_.sampling[2];
+    if (!Cb.used_ || !Cr.used_ || cb.horizontal != 1 || cb.vertical != 1 ||
+        cr.horizontal != 1 || cr.vertical != 1) {
+        return &JPEGDecoder::DecodeMCUBlock;
+    }
+    size_t width = Cb.horizontal * Cb.block_width / block_size_;
+    size_t hieght = Cb.vertical * Cb.block_hieght / block_size_;
+    if (width == 1 && hieght == 1) {
+        return &JPEGDecoder::DecodeMCU<1, 1, true>;
+    } else if (width == 2 && hieght == 1) {
+        return &JPEGDecoder::DecodeMCU<2, 1, true>;
+    } else if (width == 2 && hieght == 2) {
+        return &JPEGDecoder::DecodeMCU<2, 2, true>;
+    }
+    return &JPEGDecoder::DecodeMCU<1, 2, true>;
+}
 
-    bool bit = reader_.ReadBit();
-    int32_t value = bit;
+void JPEGDecoder::ProcessRestart(EntropyState& state, size_t index) {
+    state.reader->ResetBits();
+    MarkerType marker = state.reader->ReadTwoBytes();
+    if (marker != kMarkerRST0 + index % kRestartMarkerNum) {
+        DLOG(ERROR) << "Wrong restart marker\n";
+        throw std::runtime_error("Wrong restart marker\n");
+    }
+    state.last_value.fill(0);
+    state.eob_run = 0;
+}
 
-    for (size_t i = 0; i < length - 1; ++i) {
-        value <<= 1;
-        value += reader_.ReadBit();
+const uint8_t* JPEGDecoder::UpsampleRow(const Channel& channel, size_t row,
+                                        std::vector<uint8_t>& buffer) {
+    const uint8_t* input = channel.plane.data() + row / channel.vertical * channel.plane_width;
+    if (channel.horizontal == 1) {
+        return input;
     }
 
-    if (bit == 0) {
-        return value - (1 << length) + 1;
+    for (size_t j = 0; j < buffer.size(); j += 2) {
+        buffer[j] = buffer[j + 1] = input[j / 2];
     }
-    return value;
+    return buffer.data();
 }
 
-std::vector<int32_t> JPEGDecoder::DecodeTable(Channel& channel) {
-    std::vector<int32_t> table(kTableSize);
+void JPEGDecoder::OutputRows(size_t row, size_t mcu_hieght, size_t plane_row,
+                             UpsampledRows& rows, [[maybe_unused]] DecodeStats* stats) {
+    if (planar_) {
+        OutputPlanarRows(row, mcu_hieght, plane_row);
+        return;
+    }
 
-    table[0] = ReadValue(ReadCoef(channel.DHTDC));
+    size_t begin = std::max(row, crop_.y);
+    size_t end = std::min(row + mcu_hieght, crop_.y + crop_.height);
+    size_t band_stride = crop_.width * BytesPerPixel(pixel_format_);
+    for (size_t i = begin; i < end; ++i) {
+        JPEG_DECODER_STATS_ONLY(StageClock clock(stats);)
+        const uint8_t* y = UpsampleRow(Y, plane_row + i - row, rows.y) + crop_offset_;
+        const uint8_t* cb = nullptr;
+        const uint8_t* cr = nullptr;
+        if (pixel_format_ != PixelFormat::kGray8 && !gray_) {
+            cb = UpsampleRow(Cb, plane_row + i - row, rows.cb) + crop_offset_;
+            cr = UpsampleRow(Cr, plane_row + i - row, rows.cr) + crop_offset_;
+        }
+        uint8_t* output = row_callback_ ? band_.data() + (i - begin) * band_stride
+                                        : image_.Row(i - crop_.y);
+        JPEG_DECODER_STATS_ONLY(clock.Lap(&DecodeStats::upsampling_ns);)
+        color_(y, cb, cr, output, crop_.width);
+        JPEG_DECODER_STATS_ONLY(clock.Lap(&DecodeStats::color_ns);)
+    }
 
-    for (auto iterator = kZigZag.begin() + 1; iterator != kZigZag.end();) {
-        uint8_t coef = ReadCoef(channel.DHTAC);
+    if (row_callback_ && begin < end) {
+        RowBand band;
+        band.row = begin - crop_.y;
+        band.count = end - begin;
+        band.width = crop_.width;
+        band.height = crop_.height;
+        band.format = pixel_format_;
+        band.data = band_.data();
+        band.stride = band_stride;
+        row_callback_(band);
+    }
+}
 
-        if (coef == 0) {
-            while (iterator != kZigZag.end()) {
-                table[*iterator] = 0;
-                ++iterator;
+void JPEGDecoder::OutputPlanarRows(size_t row, size_t mcu_hieght, size_t plane_row) {
+    size_t plane = 0;
+    for (size_t id = 0; id < kChannelNum; ++id) {
+        const Channel& channel = GetChannelById(id);
+        if (!channel.used_) {
+            continue;
+        }
+        // Crop is rounded outwards to whole samples of the channel.
+        size_t first = crop_.y / channel.vertical;
+        size_t last = (crop_.y + crop_.height - 1) / channel.vertical;
+        size_t begin = std::max(row / channel.vertical, first);
+        size_t end = std::min((row + mcu_hieght) / channel.vertical, last + 1);
+        for (size_t i = begin; i < end; ++i) {
+            const uint8_t* input =
+                channel.plane.data() + crop_offset_ / channel.horizontal +
+                (plane_row / channel.vertical + i - row / channel.vertical) * channel.plane_width;
+            std::copy_n(input, planar_image_.Width(plane), planar_image_.Row(plane, i - first));
+        }
+        ++plane;
+    }
+}
+
+size_t JPEGDecoder::GetMCUHieght() const {
+    return std::max({Y.vertical * Y.block_hieght, Cb.vertical * Cb.block_hieght,
+                     Cr.vertical * Cr.block_hieght});
+}
+
+size_t JPEGDecoder::GetMCUWidth() const {
+    return std::max({Y.horizontal * Y.block_width, Cb.horizontal * Cb.block_width,
+                     Cr.horizontal * Cr.block_width});
+}
+
+void JPEGDecoder::PrepareBlocks() {
+    for (size_t id = 0; id < kChannelNum; ++id) {
+        Channel& channel = GetChannelById(id);
+        // Repeating the samples of a subsampled channel of a scaled image would lose its
+        // resolution for no reason, the transform makes the samples of the image instead.
+        // Planar output keeps the channels at their own resolution.
+        size_t width = block_size_ * channel.horizontal;
+        size_t hieght = block_size_ * channel.vertical;
+        channel.block_width = planar_ ? block_size_ : std::min(width, kStandartMCUSize);
+        channel.block_hieght = planar_ ? block_size_ : std::min(hieght, kStandartMCUSize);
+        channel.horizontal = static_cast<uint8_t>(width / channel.block_width);
+        channel.vertical = static_cast<uint8_t>(hieght / channel.block_hieght);
+
+        if (channel.block_width == kStandartMCUSize &&
+            channel.block_hieght == kStandartMCUSize) {
+            channel.idct = GetIDCT(idct_method_);
+            channel.dc_idct = GetDCIDCT(idct_method_);
+            channel.low_idct = GetLowIDCT(idct_method_);
+        } else {
+            channel.idct = GetReducedIDCT(channel.block_width, channel.block_hieght);
+            channel.dc_idct = channel.idct;
+            channel.low_idct = channel.idct;
+        }
+    }
+}
+
+void JPEGDecoder::PreparePlanes(size_t mcu_hieght, size_t mcu_width, size_t plane_rows) {
+    window_.first_row = crop_.y / mcu_hieght;
+    window_.last_row = (crop_.y + crop_.height - 1) / mcu_hieght;
+    window_.first_column = crop_.x / mcu_width;
+    window_.last_column = (crop_.x + crop_.width - 1) / mcu_width;
+    crop_offset_ = crop_.x - window_.first_column * mcu_width;
+    size_t window_rows = window_.last_row - window_.first_row + 1;
+    size_t window_columns = window_.last_column - window_.first_column + 1;
+    plane_rows_ = std::min(plane_rows, window_rows);
+
+    // Grayscale images skip the chroma planes and replicate Y instead of converting colors.
+    gray_ = Y.used_ && !Cb.used_ && !Cr.used_;
+    color_ = gray_ ? GetGrayConverter(pixel_format_) : GetColorConverter(pixel_format_);
+
+    // Planes hold rows of MCU of the window of each channel at its own resolution. Unused
+    // channels stay filled with the neutral value.
+    for (size_t id = 0; id < kChannelNum; ++id) {
+        Channel& channel = GetChannelById(id);
+        if (gray_ && id != 0) {
+            channel.plane.clear();
+            continue;
+        }
+        channel.plane_width = window_columns * mcu_width / channel.horizontal;
+        channel.plane.assign(channel.plane_width * (mcu_hieght / channel.vertical) * plane_rows_,
+                             128);
+    }
+    rows_.y.resize(window_columns * mcu_width);
+    if (!gray_) {
+        rows_.cb.resize(window_columns * mcu_width);
+        rows_.cr.resize(window_columns * mcu_width);
+    }
+    // The image is allocated only when the first scan is reached.
+    if (row_callback_) {
+        band_.resize(crop_.width * BytesPerPixel(pixel_format_) * mcu_hieght);
+    } else if (planar_) {
+        if (planar_image_.Planes() == 0) {
+            for (size_t id = 0; id < kChannelNum; ++id) {
+                const Channel& channel = GetChannelById(id);
+                if (channel.used_) {
+                    planar_image_.AddPlane(
+                        (crop_.x + crop_.width - 1) / channel.horizontal -
+                            crop_.x / channel.horizontal + 1,
+                        (crop_.y + crop_.height - 1) / channel.vertical -
+                            crop_.y / channel.vertical + 1);
+                }
             }
-            break;
         }
+    } else if (image_.Height() == 0) {
+        image_.SetSize(crop_.width, crop_.height, pixel_format_);
+    }
+    RecordScratch();
+}
+
+void JPEGDecoder::RecordScratch() {
+    if (stats_ == nullptr) {
+        return;
+    }
+    size_t bytes = rows_.y.capacity() + rows_.cb.capacity() + rows_.cr.capacity() +
+                   band_.capacity() + segment_.capacity() + restarts_.capacity() * sizeof(size_t) +
+                   ring_coefficients_.capacity() * sizeof(int16_t) + ring_last_.capacity();
+    for (const auto& rows : task_rows_) {
+        bytes += rows.y.capacity() + rows.cb.capacity() + rows.cr.capacity();
+    }
+    for (size_t id = 0; id < kChannelNum; ++id) {
+        const Channel& channel = GetChannelById(id);
+        bytes += channel.plane.capacity() + channel.coefficients.capacity() * sizeof(int16_t);
+    }
+    stats_->peak_scratch_bytes = std::max(stats_->peak_scratch_bytes, bytes);
+}
+
+void JPEGDecoder::StartImageCreation() {
+    if (coefficients_only_) {
+        DecodeScan(ScanInfo());
+        return;
+    }
+
+    size_t mcu_hieght = GetMCUHieght();
+    size_t mcu_width = GetMCUWidth();
+    size_t mcu_columns = (width_ - 1) / mcu_width + 1;
+    size_t mcu_rows = (height_ - 1) / mcu_hieght + 1;
+    // Files with restart markers decode intervals in parallel, the others overlap entropy
+    // decoding with the rest of the stages. Both need the whole scan.
+    bool parallel = threads_ > 1 && !row_callback_ && !incremental_;
+    // Intervals write to all rows of the window, the pipeline to a ring of rows as deep as the
+    // number of rows in flight.
+    size_t plane_rows = 1;
+    if (parallel) {
+        plane_rows = restart_interval_ != 0 ? mcu_rows : 2 * threads_;
+    }
+
+    PreparePlanes(mcu_hieght, mcu_width, plane_rows);
+    decode_mcu_ = GetMCUDecoder();
+
+    if (parallel && restart_interval_ != 0) {
+        DecodeIntervals(mcu_rows, mcu_columns, mcu_hieght, mcu_width);
+        return;
+    } else if (parallel) {
+        DecodePipelined(mcu_rows, mcu_columns, mcu_hieght, mcu_width);
+        return;
+    }
 
-        for (size_t i = 0; i < (coef >> (kByteSize / 2)) && iterator != kZigZag.end(); ++i) {
-            table[*iterator] = 0;
-            ++iterator;
+    // Incremental input decodes the MCU with TryDecodeRow as the data arrives.
+    scan_state_ = EntropyState{&reader_};
+    scan_state_.stats = stats_;
+    scan_row_ = 0;
+    scan_column_ = 0;
+    scan_columns_ = mcu_columns;
+    scan_mcu_ = 0;
+    scanning_ = true;
+    if (!incremental_) {
+        while (scanning_) {
+            while (!IsRowRead()) {
+                ReadMCU();
+            }
+            OutputRow();
         }
+    }
+}
 
-        if (iterator == kZigZag.end()) {
-            DLOG(ERROR) << "Wrong coef\n";
-            throw std::runtime_error("Wrong coef\n");
+bool JPEGDecoder::IsRowRead() const {
+    // Nothing after the last MCU of the window is read.
+    return scan_column_ == scan_columns_ ||
+           scan_mcu_ > window_.last_row * scan_columns_ + window_.last_column;
+}
+
+void JPEGDecoder::ReadMCU() {
+    if (restart_interval_ != 0 && scan_mcu_ != 0 && scan_mcu_ % restart_interval_ == 0) {
+        ProcessRestart(scan_state_, scan_mcu_ / restart_interval_ - 1);
+    }
+    // MCU outside of the window are only entropy decoded.
+    if (window_.Contains(scan_row_, scan_column_)) {
+        (this->*decode_mcu_)(scan_state_, 0, scan_column_ - window_.first_column,
+                             GetMCUHieght(), GetMCUWidth());
+    } else {
+        SkipMCUBlock(scan_state_, GetMCUHieght(), GetMCUWidth());
+    }
+    ++scan_column_;
+    ++scan_mcu_;
+}
+
+void JPEGDecoder::OutputRow() {
+    size_t mcu_hieght = GetMCUHieght();
+    if (scan_row_ >= window_.first_row) {
+        OutputRows(scan_row_ * mcu_hieght, mcu_hieght, 0, rows_, stats_);
+        rows_ready_ = std::min((scan_row_ + 1) * mcu_hieght, crop_.y + crop_.height) - crop_.y;
+    }
+    scan_column_ = 0;
+    if (++scan_row_ <= window_.last_row) {
+        return;
+    }
+
+    scanning_ = false;
+    reader_.ResetBits();
+    if (scan_mcu_ != scan_columns_ * ((height_ - 1) / mcu_hieght + 1)) {
+        stopped_ = true;
+        finish_ = true;
+    }
+}
+
+bool JPEGDecoder::TryDecodeRow() {
+    while (!IsRowRead()) {
+        BitReader::State input = reader_.Save();
+        EntropyState state = scan_state_;
+        size_t column = scan_column_;
+        size_t mcu = scan_mcu_;
+        bool suspended = false;
+        try {
+            ReadMCU();
+            suspended = reader_.IsPastEnd();
+        } catch (const std::exception&) {
+            // Invalid data at the end of the input may be a code cut in the middle.
+            if (!reader_.IsAtEnd()) {
+                throw;
+            }
+            suspended = true;
+        }
+        if (suspended) {
+            reader_.Restore(input);
+            scan_state_ = state;
+            scan_column_ = column;
+            scan_mcu_ = mcu;
+            return false;
         }
-        table[*iterator] = ReadValue(coef % (1 << (kByteSize / 2)));
-        ++iterator;
     }
+    OutputRow();
+    return true;
+}
 
-    table[0] += channel.last_value;
-    channel.last_value = table[0];
+void JPEGDecoder::DecodePipelined(size_t mcu_rows, size_t mcu_columns, size_t mcu_hieght,
+                                  size_t mcu_width) {
+    size_t window_rows = window_.last_row - window_.first_row + 1;
+    size_t window_columns = window_.last_column - window_.first_column + 1;
+    // A slot holds the blocks of the channels one after another, blocks of a channel go row
+    // by row.
+    std::array<size_t, kChannelNum> offsets{};
+    size_t slot_blocks = 0;
+    for (size_t id = 0; id < kChannelNum; ++id) {
+        const Channel& channel = GetChannelById(id);
+        offsets[id] = slot_blocks;
+        if (channel.used_) {
+            slot_blocks += (mcu_hieght / channel.vertical / channel.block_hieght) *
+                           (window_columns * mcu_width / channel.horizontal / channel.block_width);
+        }
+    }
+    RowRing ring(plane_rows_);
+    ring_coefficients_.assign(ring.Depth() * slot_blocks * kTableSize, 0);
+    ring_last_.resize(ring.Depth() * slot_blocks);
+    // The calling thread uses rows_ when it helps the tasks.
+    size_t tasks = std::min(threads_ - 1, window_rows);
+    task_rows_.resize(tasks);
+    for (auto& rows : task_rows_) {
+        rows.y.resize(rows_.y.size());
+        rows.cb.resize(rows_.cb.size());
+        rows.cr.resize(rows_.cr.size());
+    }
+    RecordScratch();
 
-    ProductTable(table, channel.DQT);
+    // Transforms the blocks of the slot of |item| to the rows of the planes of the same slot,
+    // clears them for the next item and converts the rows to pixels. The slot is released only
+    // after the conversion, the next item of the slot overwrites the planes.
+    auto reconstruct = [&](size_t item, UpsampledRows& rows, DecodeStats* stats) {
+        JPEG_DECODER_STATS_ONLY(StageClock clock(stats);)
+        size_t slot = item % ring.Depth();
+        for (size_t id = 0; id < kChannelNum; ++id) {
+            Channel& channel = GetChannelById(id);
+            if (!channel.used_) {
+                continue;
+            }
+            size_t hieght = mcu_hieght / channel.vertical;
+            size_t width = window_columns * mcu_width / channel.horizontal;
+            size_t first = slot * slot_blocks + offsets[id];
+            size_t blocks_width = width / channel.block_width;
+            for (size_t i = 0; i < hieght / channel.block_hieght; ++i) {
+                uint8_t* output = channel.plane.data() +
+                                  (slot * hieght + i * channel.block_hieght) * channel.plane_width;
+                for (size_t j = 0; j < blocks_width; ++j) {
+                    size_t block = first + i * blocks_width + j;
+                    int16_t* table = ring_coefficients_.data() + block * kTableSize;
+                    TransformBlock(channel, table, ring_last_[block],
+                                   output + j * channel.block_width, channel.plane_width, stats);
+                    std::fill_n(table, kTableSize, 0);
+                }
+            }
+        }
+        JPEG_DECODER_STATS_ONLY(clock.Lap(&DecodeStats::idct_ns);)
+        OutputRows((window_.first_row + item) * mcu_hieght, mcu_hieght, slot * mcu_hieght, rows,
+                   stats);
+        ring.Release(item);
+    };
 
-    IDCT(table);
+    // Rows are reconstructed on the shared pool if there is one, otherwise on own threads.
+    std::unique_ptr<ThreadPool> own_pool;
+    ThreadPool* pool = pool_;
+    if (pool == nullptr) {
+        own_pool = std::make_unique<ThreadPool>(tasks);
+        pool = own_pool.get();
+    }
+    std::vector<std::future<void>> results(tasks);
+    JPEG_DECODER_STATS_ONLY(std::vector<DecodeStats> task_stats(tasks);)
+    for (size_t task = 0; task < tasks; ++task) {
+        results[task] = pool->Submit([&, task] {
+            DecodeStats* stats = nullptr;
+            JPEG_DECODER_STATS_ONLY(stats = stats_ != nullptr ? &task_stats[task] : nullptr;)
+            size_t item = 0;
+            while (ring.Claim(item)) {
+                reconstruct(item, task_rows_[task], stats);
+            }
+        });
+    }
+    auto finish = [&] {
+        ring.Close();
+        for (auto& result : results) {
+            pool->Wait(result);
+        }
+    };
 
-    Norm(table);
+    // Nothing after the last MCU of the window is read. While the slot of the next row is
+    // taken, the calling thread reconstructs rows itself.
+    EntropyState state{&reader_};
+    state.stats = stats_;
+    size_t mcu_count = 0;
+    size_t mcu_last = window_.last_row * mcu_columns + window_.last_column;
+    try {
+        for (size_t row = 0; row <= window_.last_row; ++row) {
+            size_t item = row - window_.first_row;
+            size_t claimed = 0;
+            while (row >= window_.first_row && !ring.CanWrite(item)) {
+                if (ring.TryClaim(claimed)) {
+                    reconstruct(claimed, rows_, stats_);
+                } else {
+                    ring.WaitWritable(item);
+                }
+            }
+            JPEG_DECODER_STATS_ONLY(StageClock clock(stats_);)
+            for (size_t column = 0; column < mcu_columns && mcu_count <= mcu_last;
+                 ++column, ++mcu_count) {
+                if (!window_.Contains(row, column)) {
+                    SkipMCUBlock(state, mcu_hieght, mcu_width);
+                    continue;
+                }
+                JPEG_DECODER_STATS_ONLY(if (stats_ != nullptr) {
+                    ++stats_->mcus;
+                })
+                for (size_t id = 0; id < kChannelNum; ++id) {
+                    const Channel& channel = GetChannelById(id);
+                    if (!channel.used_) {
+                        continue;
+                    }
+                    size_t hieght = mcu_hieght / channel.vertical / channel.block_hieght;
+                    size_t width = mcu_width / channel.horizontal / channel.block_width;
+                    size_t first = (item % ring.Depth()) * slot_blocks + offsets[id] +
+                                   (column - window_.first_column) * width;
+                    for (size_t i = 0; i < hieght; ++i) {
+                        for (size_t j = 0; j < width; ++j) {
+                            size_t block = first + i * window_columns * width + j;
+                            ring_last_[block] = static_cast<uint8_t>(ReadBlock(
+                                *state.reader, *channel.DHTDC, *channel.DHTAC, state.last_value[id],
+                                ring_coefficients_.data() + block * kTableSize, state.stats));
+                        }
+                    }
+                }
+            }
+            JPEG_DECODER_STATS_ONLY(clock.Lap(&DecodeStats::entropy_ns);)
+            if (row >= window_.first_row) {
+                ring.Publish();
+            }
+        }
+    } catch (...) {
+        finish();
+        throw;
+    }
+    size_t item = 0;
+    while (ring.TryClaim(item)) {
+        reconstruct(item, rows_, stats_);
+    }
+    finish();
+    for (auto& result : results) {
+        result.get();
+    }
+    JPEG_DECODER_STATS_ONLY(if (stats_ != nullptr) {
+        for (const auto& stats : task_stats) {
+            stats_->Merge(stats);
+        }
+    })
 
-    return table;
+    reader_.ResetBits();
+    if (mcu_count != mcu_rows * mcu_columns) {
+        stopped_ = true;
+        finish_ = true;
+    }
 }
 
-std::vector<uint8_t> JPEGDecoder::DecodeChannel(Channel& channel, size_t mcu_hieght,
-                                                size_t mcu_width) {
-    std::vector<uint8_t> res(mcu_hieght * mcu_width / (channel.vertical * channel.horizontal), 128);
-    if (!channel.used_) {
-        return res;
+void JPEGDecoder::DecodeIntervals(size_t mcu_rows, size_t mcu_columns, size_t mcu_hieght,
+                                  size_t mcu_width) {
+    std::vector<uint8_t>& segment = segment_;
+    std::vector<size_t>& restarts = restarts_;
+    reader_.ReadSegment(segment, restarts);
+    RecordScratch();
+
+    size_t mcu_count = mcu_rows * mcu_columns;
+    if (restarts.size() != (mcu_count - 1) / restart_interval_ + 1) {
+        DLOG(ERROR) << "Wrong number of restart intervals\n";
+        throw std::runtime_error("Wrong number of restart intervals\n");
     }
 
-    for (size_t i = 0; i < mcu_hieght / channel.vertical; i += kStandartMCUSize) {
-        for (size_t j = 0; j < mcu_width / channel.horizontal; j += kStandartMCUSize) {
-            auto table = DecodeTable(channel);
-            for (size_t row = 0; row < kStandartMCUSize; ++row) {
-                for (size_t column = 0; column < kStandartMCUSize; ++column) {
-                    res[(row + i) * (mcu_width / channel.horizontal) + column + j] =
-                        table[row * kStandartMCUSize + column];
+    // Intervals without MCU of the window are not decoded at all.
+    size_t mcu_first = window_.first_row * mcu_columns + window_.first_column;
+    size_t mcu_last = window_.last_row * mcu_columns + window_.last_column;
+    size_t interval_first = mcu_first / restart_interval_;
+    size_t interval_last = mcu_last / restart_interval_;
+    // Intervals run on the shared pool if there is one, otherwise on threads_ - 1 own threads.
+    // The waiting thread helps with them in both cases.
+    std::unique_ptr<ThreadPool> own_pool;
+    ThreadPool* pool = pool_;
+    if (pool == nullptr) {
+        own_pool = std::make_unique<ThreadPool>(
+            std::min(threads_ - 1, interval_last - interval_first + 1));
+        pool = own_pool.get();
+    }
+    // One task per thread takes the intervals in order, so the number of allocations does not
+    // depend on the number of intervals.
+    std::atomic<size_t> next_interval{interval_first};
+    size_t tasks = std::min(threads_, interval_last - interval_first + 1);
+    std::vector<std::future<void>> results(tasks);
+    JPEG_DECODER_STATS_ONLY(std::mutex stats_mutex;)
+    for (size_t task = 0; task < tasks; ++task) {
+        results[task] = pool->Submit([&] {
+            JPEG_DECODER_STATS_ONLY(DecodeStats task_stats;)
+            for (size_t i = next_interval++; i <= interval_last; i = next_interval++) {
+                size_t end = i + 1 < restarts.size() ? restarts[i + 1] : segment.size();
+                BitReader reader(segment.data() + restarts[i], end - restarts[i]);
+                EntropyState state{&reader};
+                JPEG_DECODER_STATS_ONLY(state.stats = stats_ != nullptr ? &task_stats : nullptr;)
+                size_t last = std::min(mcu_last + 1, (i + 1) * restart_interval_);
+                for (size_t mcu = i * restart_interval_; mcu < last; ++mcu) {
+                    size_t row = mcu / mcu_columns;
+                    size_t column = mcu % mcu_columns;
+                    if (window_.Contains(row, column)) {
+                        (this->*decode_mcu_)(state, row - window_.first_row,
+                                             column - window_.first_column, mcu_hieght,
+                                             mcu_width);
+                    } else {
+                        SkipMCUBlock(state, mcu_hieght, mcu_width);
+                    }
                 }
             }
+            JPEG_DECODER_STATS_ONLY(if (stats_ != nullptr) {
+                std::lock_guard<std::mutex> lock(stats_mutex);
+                stats_->Merge(task_stats);
+            })
+        });
+    }
+    for (auto& result : results) {
+        pool->Wait(result);
+    }
+    for (auto& result : results) {
+        result.get();
+    }
+
+    for (size_t row = window_.first_row; row <= window_.last_row; ++row) {
+        OutputRows(row * mcu_hieght, mcu_hieght, (row - window_.first_row) * mcu_hieght, rows_,
+                   stats_);
+    }
+}
+
+void JPEGDecoder::DecodeDCFirst(EntropyState& state, size_t id, int16_t* coef,
+                                const ScanInfo& scan) {
+    int32_t value = 0;
+    ReadCoef(*state.reader, *GetChannelById(id).DHTDC, value);
+    state.last_value[id] += value;
+    coef[0] = static_cast<int16_t>(state.last_value[id] * (1 << scan.approx_low));
+}
+
+void JPEGDecoder::DecodeDCRefine(EntropyState& state, int16_t* coef, const ScanInfo& scan) {
+    if (state.reader->GetBits(1) != 0) {
+        coef[0] = static_cast<int16_t>(coef[0] | (1 << scan.approx_low));
+    }
+}
+
+void JPEGDecoder::DecodeACFirst(EntropyState& state, size_t id, int16_t* coef,
+                                const ScanInfo& scan) {
+    if (state.eob_run > 0) {
+        --state.eob_run;
+        return;
+    }
+
+    const Channel& channel = GetChannelById(id);
+    int32_t value = 0;
+    for (size_t i = scan.spectral_start; i <= scan.spectral_end; ++i) {
+        uint8_t symbol = ReadCoef(*state.reader, *channel.DHTAC, value);
+        size_t run = symbol >> (kByteSize / 2);
+
+        if (symbol % (1 << (kByteSize / 2)) == 0) {
+            if (run != 15) {
+                state.eob_run = (size_t(1) << run) - 1 + state.reader->GetBits(run);
+                break;
+            }
+            i += 15;
+            continue;
+        }
+
+        i += run;
+        if (i > scan.spectral_end) {
+            DLOG(ERROR) << "Wrong coef\n";
+            throw std::runtime_error("Wrong coef\n");
         }
+        coef[kZigZag[i]] = static_cast<int16_t>(value * (1 << scan.approx_low));
     }
+}
 
-    return res;
+void JPEGDecoder::RefineCoef(BitReader& reader, int16_t& coef, int32_t bit) {
+    if (reader.GetBits(1) != 0 && (coef & bit) == 0) {
+        coef = static_cast<int16_t>(coef >= 0 ? coef + bit : coef - bit);
+    }
 }
 
-RGB JPEGDecoder::YCbCrToRGB(uint8_t y, uint8_t cb, uint8_t cr) {
-    int r = round(static_cast<double>(y) + 1.402 * (static_cast<double>(cr) - 128.));
-    int g = round(static_cast<double>(y) - 0.34414 * (static_cast<double>(cb) - 128.) -
-                  0.71414 * (static_cast<double>(cr) - 128.));
-    int b = round(static_cast<double>(y) + 1.772 * (static_cast<double>(cb) - 128.));
+void JPEGDecoder::DecodeACRefine(EntropyState& state, size_t id, int16_t* coef,
+                                 const ScanInfo& scan) {
+    BitReader& reader = *state.reader;
+    const Channel& channel = GetChannelById(id);
+    int32_t bit = 1 << scan.approx_low;
+    size_t i = scan.spectral_start;
+
+    if (state.eob_run == 0) {
+        int32_t value = 0;
+        for (; i <= scan.spectral_end; ++i) {
+            uint8_t symbol = ReadCoef(reader, *channel.DHTAC, value);
+            size_t run = symbol >> (kByteSize / 2);
+            size_t size = symbol % (1 << (kByteSize / 2));
+
+            if (size == 0 && run != 15) {
+                state.eob_run = (size_t(1) << run) + reader.GetBits(run);
+                break;
+            }
+            if (size > 1) {
+                DLOG(ERROR) << "Wrong coef\n";
+                throw std::runtime_error("Wrong coef\n");
+            }
+
+            // Skips |run| zero coefficients, refining the nonzero ones on the way, the new
+            // coefficient takes the next zero position.
+            for (; i <= scan.spectral_end; ++i) {
+                int16_t& current = coef[kZigZag[i]];
+                if (current != 0) {
+                    RefineCoef(reader, current, bit);
+                } else if (run == 0) {
+                    break;
+                } else {
+                    --run;
+                }
+            }
+            if (size != 0 && i <= scan.spectral_end) {
+                coef[kZigZag[i]] = static_cast<int16_t>(value * bit);
+            }
+        }
+    }
 
-    return {.r = std::min(255, std::max(0, r)),
-            .g = std::min(255, std::max(0, g)),
-            .b = std::min(255, std::max(0, b))};
+    if (state.eob_run > 0) {
+        for (; i <= scan.spectral_end; ++i) {
+            int16_t& current = coef[kZigZag[i]];
+            if (current != 0) {
+                RefineCoef(reader, current, bit);
+            }
+        }
+        --state.eob_run;
+    }
 }
 
-uint8_t JPEGDecoder::Get(std::vector<uint8_t>& vec, size_t i, size_t j, size_t width) {
-    return vec[i * width + j];
+void JPEGDecoder::DecodeProgressiveBlock(EntropyState& state, size_t id, int16_t* coef,
+                                         const ScanInfo& scan) {
+    if (!progressive_) {
+        const Channel& channel = GetChannelById(id);
+        ReadBlock(*state.reader, *channel.DHTDC, *channel.DHTAC, state.last_value[id], coef,
+                  state.stats);
+        return;
+    }
+
+    JPEG_DECODER_STATS_ONLY(if (state.stats != nullptr) {
+        ++state.stats->blocks;
+    })
+    if (scan.spectral_start == 0) {
+        if (scan.approx_high == 0) {
+            DecodeDCFirst(state, id, coef, scan);
+        } else {
+            DecodeDCRefine(state, coef, scan);
+        }
+    } else if (scan.approx_high == 0) {
+        DecodeACFirst(state, id, coef, scan);
+    } else {
+        DecodeACRefine(state, id, coef, scan);
+    }
 }
 
-void JPEGDecoder::DecodeMCUBlock(size_t row, size_t column, size_t mcu_hieght, size_t mcu_width) {
-    std::vector<uint8_t> y_vec = DecodeChannel(Y, mcu_hieght, mcu_width);
-    std::vector<uint8_t> cb_vec = DecodeChannel(Cb, mcu_hieght, mcu_width);
-    std::vector<uint8_t> cr_vec = DecodeChannel(Cr, mcu_hieght, mcu_width);
+void JPEGDecoder::DecodeScan(const ScanInfo& scan) {
+    size_t mcu_hieght = GetMCUHieght();
+    size_t mcu_width = GetMCUWidth();
+    size_t mcu_columns = (width_ - 1) / mcu_width + 1;
+    size_t mcu_rows = (height_ - 1) / mcu_hieght + 1;
+
+    // Coefficients are kept for the whole grid of MCU, in natural order inside the block.
+    for (size_t id = 0; id < kChannelNum; ++id) {
+        Channel& channel = GetChannelById(id);
+        if (channel.used_ && channel.coefficients.empty()) {
+            channel.coef_width =
+                mcu_columns * mcu_width / channel.horizontal / channel.block_width;
+            size_t coef_hieght = mcu_rows * mcu_hieght / channel.vertical / channel.block_hieght;
+            channel.coefficients.assign(channel.coef_width * coef_hieght * kTableSize, 0);
+        }
+    }
+    RecordScratch();
+
+    EntropyState state{&reader_};
+    state.stats = stats_;
+    JPEG_DECODER_STATS_ONLY(StageClock clock(stats_);)
+    size_t mcu_count = 0;
+    auto restart = [&] {
+        if (restart_interval_ != 0 && mcu_count != 0 && mcu_count % restart_interval_ == 0) {
+            ProcessRestart(state, mcu_count / restart_interval_ - 1);
+        }
+        ++mcu_count;
+    };
 
-    for (size_t i = row; i < std::min(row + mcu_hieght, image_.Height()); ++i) {
-        for (size_t j = column; j < std::min(column + mcu_width, image_.Width()); ++j) {
-            image_.SetPixel(
-                i, j,
-                YCbCrToRGB(Get(y_vec, (i - row) / Y.vertical, (j - column) / Y.horizontal,
-                               mcu_width / Y.horizontal),
-                           Get(cb_vec, (i - row) / Cb.vertical, (j - column) / Cb.horizontal,
-                               mcu_width / Cb.horizontal),
-                           Get(cr_vec, (i - row) / Cr.vertical, (j - column) / Cr.horizontal,
-                               mcu_width / Cr.horizontal)));
+    size_t scan_channels = 0;
+    size_t scan_id = 0;
+    for (size_t id = 0; id < kChannelNum; ++id) {
+        if (GetChannelById(id).in_scan) {
+            ++scan_channels;
+            scan_id = id;
         }
     }
+
+    if (scan_channels == 1) {
+        // Non-interleaved scan covers only the blocks inside the channel, one block per MCU.
+        Channel& channel = GetChannelById(scan_id);
+        size_t blocks_width = (width_ - 1) / (channel.horizontal * channel.block_width) + 1;
+        size_t blocks_hieght = (height_ - 1) / (channel.vertical * channel.block_hieght) + 1;
+        for (size_t i = 0; i < blocks_hieght; ++i) {
+            for (size_t j = 0; j < blocks_width; ++j) {
+                restart();
+                DecodeProgressiveBlock(
+                    state, scan_id,
+                    channel.coefficients.data() + (i * channel.coef_width + j) * kTableSize,
+                    scan);
+            }
+        }
+    } else {
+        for (size_t row = 0; row < mcu_rows; ++row) {
+            for (size_t column = 0; column < mcu_columns; ++column) {
+                restart();
+                for (size_t id = 0; id < kChannelNum; ++id) {
+                    Channel& channel = GetChannelById(id);
+                    if (!channel.in_scan) {
+                        continue;
+                    }
+                    size_t hieght = mcu_hieght / channel.vertical / channel.block_hieght;
+                    size_t width = mcu_width / channel.horizontal / channel.block_width;
+                    for (size_t i = row * hieght; i < (row + 1) * hieght; ++i) {
+                        for (size_t j = column * width; j < (column + 1) * width; ++j) {
+                            DecodeProgressiveBlock(
+                                state, id,
+                                channel.coefficients.data() +
+                                    (i * channel.coef_width + j) * kTableSize,
+                                scan);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    JPEG_DECODER_STATS_ONLY(if (stats_ != nullptr) {
+        clock.Lap(&DecodeStats::entropy_ns);
+        stats_->mcus += mcu_count;
+    })
+    reader_.ResetBits();
+    ++scans_;
+    if (max_scans_ != 0 && scans_ == max_scans_) {
+        if (!coefficients_only_) {
+            RenderCoefficients();
+        }
+        stopped_ = true;
+        finish_ = true;
+    }
 }
 
-void JPEGDecoder::StartImageCreation() {
-    size_t mcu_hieght = kStandartMCUSize * std::max({Y.vertical, Cb.vertical, Cr.vertical});
-    size_t mcu_width = kStandartMCUSize * std::max({Y.horizontal, Cb.horizontal, Cr.horizontal});
+void JPEGDecoder::RenderCoefficients() {
+    size_t mcu_hieght = GetMCUHieght();
+    size_t mcu_width = GetMCUWidth();
+    PreparePlanes(mcu_hieght, mcu_width, 1);
 
-    for (size_t row = 0; row < (image_.Height() - 1) / mcu_hieght + 1; ++row) {
-        for (size_t column = 0; column < (image_.Width() - 1) / mcu_width + 1; ++column) {
-            DecodeMCUBlock(row * mcu_hieght, column * mcu_width, mcu_hieght, mcu_width);
+    for (size_t row = window_.first_row; row <= window_.last_row; ++row) {
+        JPEG_DECODER_STATS_ONLY(StageClock clock(stats_);)
+        for (size_t column = window_.first_column; column <= window_.last_column; ++column) {
+            for (size_t id = 0; id < kChannelNum; ++id) {
+                Channel& channel = GetChannelById(id);
+                if (!channel.used_) {
+                    continue;
+                }
+                size_t hieght = mcu_hieght / channel.vertical;
+                size_t width = mcu_width / channel.horizontal;
+                uint8_t* output =
+                    channel.plane.data() + (column - window_.first_column) * width;
+                size_t first = (row * hieght / channel.block_hieght) * channel.coef_width +
+                               column * width / channel.block_width;
+                for (size_t i = 0; i < hieght; i += channel.block_hieght) {
+                    for (size_t j = 0; j < width; j += channel.block_width) {
+                        size_t block = first + i / channel.block_hieght * channel.coef_width +
+                                       j / channel.block_width;
+                        const int16_t* coef = channel.coefficients.data() + block * kTableSize;
+                        channel.idct(coef, *channel.idct_table,
+                                     output + i * channel.plane_width + j, channel.plane_width);
+                        JPEG_DECODER_STATS_ONLY(if (stats_ != nullptr) {
+                            ++stats_->idct_blocks;
+                        })
+                    }
+                }
+            }
         }
+        JPEG_DECODER_STATS_ONLY(clock.Lap(&DecodeStats::idct_ns);)
+        OutputRows(row * mcu_hieght, mcu_hieght, 0, rows_, stats_);
     }
+    rows_ready_ = crop_.height;
 }
 
 bool JPEGDecoder::IsDecoding() {
     return !finish_;
 }
 
+bool JPEGDecoder::IsStopped() {
+    return stopped_;
+}
+
+DecodeStats* JPEGDecoder::GetStats() {
+    return stats_;
+}
+
+size_t JPEGDecoder::GetPosition() const {
+    return reader_.Position();
+}
+
 MarkerType JPEGDecoder::GetMarker() {
     return reader_.ReadTwoBytes();
 }
@@ -208,6 +1113,80 @@ Image& JPEGDecoder::GetImage() {
     return image_;
 }
 
+ImageHeader& JPEGDecoder::GetHeader() {
+    return header_;
+}
+
+Image JPEGDecoder::TakeImage() {
+    return std::move(image_);
+}
+
+void JPEGDecoder::SetCoefficientOutput() {
+    coefficients_only_ = true;
+}
+
+CoefficientImage JPEGDecoder::TakeCoefficients() {
+    CoefficientImage result;
+    result.width = header_.width;
+    result.height = header_.height;
+    result.comment = header_.comment;
+    for (size_t id = 0; id < kChannelNum; ++id) {
+        Channel& channel = GetChannelById(id);
+        if (!channel.used_) {
+            continue;
+        }
+        CoefficientPlane plane;
+        plane.sampling = header_.sampling[id];
+        const std::vector<int32_t>& dqt = GetTableById(channel.DQTid);
+        std::copy(dqt.begin(), dqt.end(), plane.quant_table.begin());
+        if (!channel.coefficients.empty()) {
+            plane.width_in_blocks = channel.coef_width;
+            plane.height_in_blocks = channel.coefficients.size() / kTableSize / channel.coef_width;
+            plane.coefficients = std::move(channel.coefficients);
+            channel.coefficients.clear();
+        }
+        result.components.push_back(std::move(plane));
+    }
+    return result;
+}
+
+void JPEGDecoder::SetIncrementalInput() {
+    incremental_ = true;
+}
+
+void JPEGDecoder::AppendInput(const uint8_t* data, size_t size) {
+    reader_.Append(data, size);
+}
+
+size_t JPEGDecoder::GetAvailable() const {
+    return reader_.Available();
+}
+
+uint8_t JPEGDecoder::PeekByte(size_t offset) const {
+    return reader_.PeekByte(offset);
+}
+
+bool JPEGDecoder::IsScanning() const {
+    return scanning_;
+}
+
+size_t JPEGDecoder::GetRowsReady() const {
+    return rows_ready_;
+}
+
+void JPEGDecoder::SetPlanarOutput() {
+    planar_ = true;
+}
+
+PlanarImage JPEGDecoder::TakePlanarImage() {
+    planar_image_.SetComment(header_.comment);
+    return std::move(planar_image_);
+}
+
+void JPEGDecoder::SetRowCallback(RowCallback callback) {
+    row_callback_ = std::move(callback);
+}
+
 uint8_t JPEGDecoder::ReadByte() {
     return reader_.ReadByte();
 }
@@ -216,20 +1195,59 @@ uint16_t JPEGDecoder::ReadTwoBytes() {
     return reader_.ReadTwoBytes();
 }
 
+void JPEGDecoder::ReadBytes(uint8_t* data, size_t count) {
+    reader_.ReadBytes(data, count);
+}
+
+void JPEGDecoder::SkipBytes(size_t count) {
+    reader_.SkipBytes(count);
+}
+
 void JPEGDecoder::SetComment(const std::string& comment) {
     image_.SetComment(comment);
+    header_.comment = comment;
+}
+
+void JPEGDecoder::SetRestartInterval(size_t interval) {
+    restart_interval_ = interval;
+    header_.restart_interval = interval;
 }
 
 void JPEGDecoder::ReachEnd() {
     finish_ = true;
+    if (progressive_ && scans_ != 0 && !coefficients_only_) {
+        RenderCoefficients();
+    }
+}
+
+void JPEGDecoder::SetProgressive() {
+    progressive_ = true;
+    header_.progressive = true;
+}
+
+bool JPEGDecoder::IsProgressive() {
+    return progressive_;
 }
 
 void JPEGDecoder::SetSize(size_t width, size_t height) {
-    if (image_.Height() != 0) {
+    if (IsSizeSet()) {
         DLOG(ERROR) << "Set size twice\n";
         throw std::runtime_error("Set size twice\n");
     }
-    image_.SetSize(width, height);
+    header_.width = width;
+    header_.height = height;
+    width_ = (width - 1) / scale_ + 1;
+    height_ = (height - 1) / scale_ + 1;
+    if (crop_.width == 0 || crop_.height == 0) {
+        crop_ = {0, 0, width_, height_};
+    } else if (crop_.x + crop_.width > width_ || crop_.y + crop_.height > height_) {
+        DLOG(ERROR) << "Crop is out of the image\n";
+        throw std::runtime_error("Crop is out of the image\n");
+    }
+}
+
+bool JPEGDecoder::IsSizeSet() {
+    return width_ != 0;
 }
 
 std::vector<int32_t>& JPEGDecoder::GetTableById(MarkerType id) {
@@ -251,9 +1269,16 @@ void JPEGDecoder::ProcessChannel(Channel& channel) {
         return;
     }
 
-    channel.DQT = GetTableById(channel.DQTid);
-    if (channel.DQT.empty()) {
+    const std::vector<int32_t>& dqt = GetTableById(channel.DQTid);
+    if (dqt.empty()) {
         DLOG(ERROR) << "Empty DQT table\n";
         throw std::runtime_error("Empty DQT table\n");
     }
+
+    channel.idct_table = tables_.GetIDCTTable(idct_method_, dqt);
+}
+
+const HuffmanTree* JPEGDecoder::GetHuffmanTree(const std::vector<uint8_t>& code_lengths,
+                                               const std::vector<uint8_t>& values) {
+    return tables_.GetHuffmanTree(code_lengths, values);
 }
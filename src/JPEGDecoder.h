@@ -1,23 +1,88 @@
 #pragma once
 
+#include <array>
 #include <cstddef>
 #include <cstdint>
 #include <vector>
 #include "bitReader.h"
+#include "coefficients.h"
+#include "color.h"
 #include "cons.h"
+#include "header.h"
 #include "image.h"
 #include "huffman.h"
-#include "fft.h"
+#include "idct.h"
+#include "options.h"
+#include "stats.h"
+#include "tableCache.h"
+
+class ThreadPool;
 
 struct Channel {
+    // Upsampling factors from the plane to the image.
     uint8_t horizontal = 1;
     uint8_t vertical = 1;
-    std::vector<int32_t> DQT;
-    MarkerType DQTid;
-    HuffmanTree* DHTAC;
-    HuffmanTree* DHTDC;
-    int32_t last_value = 0;
+    // Samples of a block in the plane: 8 / scale, up to twice that for subsampled channels of
+    // a scaled image, which the transform reconstructs at the resolution of the image.
+    size_t block_width = kStandartMCUSize;
+    size_t block_hieght = kStandartMCUSize;
+    // Kernels of the blocks, for sparse blocks of baseline scans and for the rest.
+    IDCTFunction idct = nullptr;
+    IDCTFunction dc_idct = nullptr;
+    IDCTFunction low_idct = nullptr;
+    MarkerType DQTid = 0;
+    // Tables of the current scan, owned by the table cache of the decoder.
+    const IDCTTable* idct_table = nullptr;
+    const HuffmanTree* DHTAC = nullptr;
+    const HuffmanTree* DHTDC = nullptr;
+    // Samples of the current row of MCU.
+    std::vector<uint8_t> plane;
+    size_t plane_width = 0;
+    // Coefficients of all blocks of a progressive image, coef_width blocks in a row.
+    std::vector<int16_t> coefficients;
+    size_t coef_width = 0;
     bool used_ = false;
+    // Channel is a part of the current scan.
+    bool in_scan = false;
+};
+
+// State of entropy decoding, each restart interval can be decoded with its own.
+struct EntropyState {
+    BitReader* reader = nullptr;
+    std::array<int32_t, kChannelNum> last_value{};
+    // Number of blocks left in the current run of empty blocks of a progressive scan.
+    size_t eob_run = 0;
+    // Statistics of the blocks decoded with this state, nullptr if they are not collected.
+    DecodeStats* stats = nullptr;
+};
+
+// Full resolution rows of channels that need horizontal upsampling, each thread converting
+// rows to pixels needs its own.
+struct UpsampledRows {
+    std::vector<uint8_t> y;
+    std::vector<uint8_t> cb;
+    std::vector<uint8_t> cr;
+};
+
+// Spectral selection and successive approximation parameters of a progressive scan.
+struct ScanInfo {
+    size_t spectral_start = 0;
+    size_t spectral_end = kTableSize - 1;
+    size_t approx_high = 0;
+    size_t approx_low = 0;
+};
+
+// MCU touching the decoded rectangle, bounds are inclusive.
+struct MCUWindow {
+    size_t first_row = 0;
+    size_t last_row = 0;
+    size_t first_column = 0;
+    size_t last_column = 0;
+
+    bool Contains(size_t row, size_t column) const {
+        return row >= first_row && row <= last_row && column >= first_column &&
+               column <= last_column;
+    }
 };
 
 class JPEGDecoder {
@@ -27,10 +92,9 @@ public:
     std::vector<int32_t> DQT10;
     std::vector<int32_t> DQT11;
 
-    HuffmanTree DHTAC0;
-    HuffmanTree DHTAC1;
-    HuffmanTree DHTDC0;
-    HuffmanTree DHTDC1;
+    // Huffman tables with ids 0 and 1, nullptr until defined.
+    std::array<const HuffmanTree*, 2> DHTAC{};
+    std::array<const HuffmanTree*, 2> DHTDC{};
 
     Channel Y;
     Channel Cb;
@@ -39,56 +103,281 @@ public:
 public:
     JPEGDecoder() = delete;
 
-    JPEGDecoder(std::istream& input);
+    JPEGDecoder(std::istream& input, const DecodeOptions& options = DecodeOptions());
+
+    // |data| must outlive the decoder.
+    JPEGDecoder(const uint8_t* data, size_t size, const DecodeOptions& options = DecodeOptions());
+
+    // Prepares the decoder for the next image read from |reader|. Buffers and tables built
+    // for the previous images are kept.
+    void Reset(BitReader&& reader, const DecodeOptions& options);
+
+    // Restart intervals are decoded as tasks of |pool| instead of own threads, the pool is
+    // kept across Reset.
+    void SetThreadPool(ThreadPool* pool);
 
     void StartImageCreation();
 
+    // Reads a scan of a progressive image, or a baseline scan in the coefficient output mode,
+    // into the coefficients of the channels of the scan.
+    void DecodeScan(const ScanInfo& scan);
+
     bool IsDecoding();
 
+    // True if decoding finished before the end of the file because the rest of it is not
+    // needed.
+    bool IsStopped();
+
+    // Returns the statistics requested by the options, nullptr if there are none.
+    DecodeStats* GetStats();
+
+    // Number of bytes of the input read so far.
+    size_t GetPosition() const;
+
     MarkerType GetMarker();
 
     size_t GetMarkerSize();
 
     Image& GetImage();
 
+    ImageHeader& GetHeader();
+
+    // Moves the decoded image out of the decoder.
+    Image TakeImage();
+
+    // Scans are only entropy decoded into the coefficients of the channels, no pixels are
+    // produced. Must be set before the first scan.
+    void SetCoefficientOutput();
+
+    // Moves the coefficients read in the coefficient output mode out of the decoder.
+    CoefficientImage TakeCoefficients();
+
+    // Input of the reader created with no data arrives through AppendInput, baseline scans are
+    // decoded with TryDecodeRow. Must be set before the first scan.
+    void SetIncrementalInput();
+
+    void AppendInput(const uint8_t* data, size_t size);
+
+    // Bytes of the input not read yet.
+    size_t GetAvailable() const;
+
+    // Returns the byte |offset| bytes after the current position without reading it.
+    uint8_t PeekByte(size_t offset) const;
+
+    // A baseline scan in the incremental input mode has rows left to decode.
+    bool IsScanning() const;
+
+    // Decodes the MCU of the current row the input holds, returns true once the row is complete
+    // and converted. An MCU cut by the end of the input is left for the next call.
+    bool TryDecodeRow();
+
+    // Number of rows of the image already converted to pixels, counted from the top of the
+    // crop.
+    size_t GetRowsReady() const;
+
+    // Channels are copied to the planes of a PlanarImage at their own resolution instead of
+    // being converted to pixels. Must be set before the first scan.
+    void SetPlanarOutput();
+
+    // Moves the planes decoded in the planar output mode out of the decoder.
+    PlanarImage TakePlanarImage();
+
+    // Rows are passed to |callback| instead of being stored in the image, which is left
+    // without pixels. Must be set before the first scan.
+    void SetRowCallback(RowCallback callback);
+
     uint8_t ReadByte();
 
     uint16_t ReadTwoBytes();
 
+    void ReadBytes(uint8_t* data, size_t count);
+
+    void SkipBytes(size_t count);
+
     void SetComment(const std::string& comment);
 
+    // Number of MCU between RSTn markers, 0 if there are no markers.
+    void SetRestartInterval(size_t interval);
+
     void ReachEnd();
 
+    void SetProgressive();
+
+    bool IsProgressive();
+
     void SetSize(size_t width, size_t height);
 
+    bool IsSizeSet();
+
+    // Sets the sizes of the blocks of the channels in their planes and the kernels making them,
+    // called once the sampling factors of the frame are read.
+    void PrepareBlocks();
+
     std::vector<int32_t>& GetTableById(MarkerType id);
 
+    // Returns the Huffman tree of a DHT segment, built once for all images with this table.
+    const HuffmanTree* GetHuffmanTree(const std::vector<uint8_t>& code_lengths,
+                                      const std::vector<uint8_t>& values);
+
     Channel& GetChannelById(size_t id);
 
     void ProcessChannel(Channel& channel);
 
 private:
+    using MCUDecoder = void (JPEGDecoder::*)(EntropyState& state, size_t row, size_t column,
+                                             size_t mcu_hieght, size_t mcu_width);
+
     BitReader reader_;
+    TableCache tables_;
+    ThreadPool* pool_ = nullptr;
     Image image_;
+    PlanarImage planar_image_;
+    ImageHeader header_;
     bool finish_;
+    bool stopped_;
+    IDCTMethod idct_method_;
+    PixelFormat pixel_format_;
+    bool planar_;
+    ColorConverter color_;
+    // Only the Y channel is present, chroma planes are neither allocated nor read.
+    bool gray_;
+    UpsampledRows rows_;
+    RowCallback row_callback_;
+    // Pixels of one row of MCU passed to row_callback_.
+    std::vector<uint8_t> band_;
+    // Entropy-coded segment of a scan decoded in parallel and offsets of its intervals.
+    std::vector<uint8_t> segment_;
+    std::vector<size_t> restarts_;
+    // Slots of the ring between the entropy and reconstruction stages of a pipelined scan:
+    // coefficients of one row of MCU of the window and zigzag positions of the last ones.
+    std::vector<int16_t> ring_coefficients_;
+    std::vector<uint8_t> ring_last_;
+    // Upsampled rows of the tasks reconstructing rows of a pipelined scan.
+    std::vector<UpsampledRows> task_rows_;
+    size_t threads_;
+    size_t restart_interval_;
+    size_t scale_;
+    // Decoder of the MCU of the current baseline scan.
+    MCUDecoder decode_mcu_;
+    // Size of the reconstructed block, kStandartMCUSize / scale_.
+    size_t block_size_;
+    // Size of the scaled image.
+    size_t width_;
+    size_t height_;
+    Rect crop_;
+    MCUWindow window_;
+    // Offset of the crop in the rows of the planes.
+    size_t crop_offset_;
+    // Number of rows of MCU the planes hold.
+    size_t plane_rows_ = 1;
+    bool progressive_;
+    bool coefficients_only_;
+    bool incremental_;
+    // Progress of the current baseline scan, the next MCU to decode.
+    bool scanning_;
+    EntropyState scan_state_;
+    size_t scan_row_;
+    size_t scan_column_;
+    size_t scan_columns_;
+    size_t scan_mcu_;
+    size_t rows_ready_;
+    // Number of scans of a progressive image read so far.
+    size_t scans_;
+    size_t max_scans_;
+    DecodeStats* stats_;
+
+    JPEGDecoder(BitReader&& reader, const DecodeOptions& options);
+
+    // Sets the state for a new image.
+    void Init(const DecodeOptions& options);
+
+    size_t GetMCUHieght() const;
+
+    size_t GetMCUWidth() const;
+
+    // Computes the window of the crop and allocates the planes for |plane_rows| rows of MCU of
+    // it, at most all of them.
+    void PreparePlanes(size_t mcu_hieght, size_t mcu_width, size_t plane_rows);
+
+    // Updates the peak scratch memory of the stats with the buffers of the decoder.
+    void RecordScratch();
+
+    // All MCU of the current row of the scan that are needed are read.
+    bool IsRowRead() const;
+
+    // Entropy decodes and transforms the next MCU of the scan into the planes.
+    void ReadMCU();
+
+    // Converts the row read by ReadMCU to pixels and moves to the next one, ends the scan
+    // after the last row of the window.
+    void OutputRow();
+
+    // Decodes MCU number |column| in MCU row |row| of the planes.
+    void DecodeMCUBlock(EntropyState& state, size_t row, size_t column, size_t mcu_hieght,
+                        size_t mcu_width);
+
+    // Same as DecodeMCUBlock for full resolution Y with kWidth x kHieght blocks in an MCU and,
+    // if kColor is set, one block of Cb and Cr.
+    template <size_t kWidth, size_t kHieght, bool kColor>
+    void DecodeMCU(EntropyState& state, size_t row, size_t column, size_t mcu_hieght,
+                   size_t mcu_width);
+
+    // Returns the DecodeMCU instance for the sampling factors of the image, DecodeMCUBlock if
+    // there is none.
+    MCUDecoder GetMCUDecoder() const;
+
+    void DecodeChannel(EntropyState& state, size_t id, size_t row, size_t column,
+                       size_t mcu_hieght, size_t mcu_width);
+
+    void DecodeTable(EntropyState& state, size_t id, uint8_t* output, size_t stride);
+
+    // Transforms the block read by ReadBlock with the kernel chosen by |last|.
+    void TransformBlock(const Channel& channel, const int16_t* table, size_t last,
+                        uint8_t* output, size_t stride, DecodeStats* stats);
+
+    // Advances the bits and DC predictors past an MCU outside of the crop.
+    void SkipMCUBlock(EntropyState& state, size_t mcu_hieght, size_t mcu_width);
+
+    void SkipTable(EntropyState& state, size_t id);
+
+    // Reads |index|-th RSTn marker and resets DC predictors.
+    void ProcessRestart(EntropyState& state, size_t index);
+
+    // Reads the whole entropy-coded segment and decodes restart intervals concurrently.
+    void DecodeIntervals(size_t mcu_rows, size_t mcu_columns, size_t mcu_hieght,
+                         size_t mcu_width);
+
+    // Entropy decodes the scan on the calling thread and passes the coefficients of each row
+    // of MCU through a ring to tasks transforming and converting them.
+    void DecodePipelined(size_t mcu_rows, size_t mcu_columns, size_t mcu_hieght,
+                         size_t mcu_width);
 
-    void DecodeMCUBlock(size_t row, size_t column, size_t mcu_hieght, size_t mcu_width);
+    void DecodeProgressiveBlock(EntropyState& state, size_t id, int16_t* coef,
+                                const ScanInfo& scan);
 
-    std::vector<uint8_t> DecodeChannel(Channel& channel, size_t mcu_hieght, size_t mcu_width);
+    void DecodeDCFirst(EntropyState& state, size_t id, int16_t* coef, const ScanInfo& scan);
 
-    std::vector<int32_t> DecodeTable(Channel& channel);
+    void DecodeDCRefine(EntropyState& state, int16_t* coef, const ScanInfo& scan);
 
-    RGB YCbCrToRGB(uint8_t y, uint8_t cb, uint8_t cr);
+    void DecodeACFirst(EntropyState& state, size_t id, int16_t* coef, const ScanInfo& scan);
 
-    uint8_t Get(std::vector<uint8_t>& vec, size_t i, size_t j, size_t width);
+    void DecodeACRefine(EntropyState& state, size_t id, int16_t* coef, const ScanInfo& scan);
 
-    uint8_t ReadCoef(HuffmanTree* huffman);
+    // Adds the next correction bit to the nonzero coefficient.
+    void RefineCoef(BitReader& reader, int16_t& coef, int32_t bit);
 
-    int32_t ReadValue(size_t length);
+    // Converts the coefficients of the window to pixels of the image.
+    void RenderCoefficients();
 
-    void ProductTable(std::vector<int32_t>& lhs, const std::vector<int32_t>& rhs);
+    // Returns |row| of the plane of |channel| at full resolution.
+    const uint8_t* UpsampleRow(const Channel& channel, size_t row, std::vector<uint8_t>& buffer);
 
-    void IDCT(std::vector<int32_t>& table);
+    // Converts the row of MCU starting from |plane_row| of the planes to pixels starting from
+    // image row |row|.
+    void OutputRows(size_t row, size_t mcu_hieght, size_t plane_row, UpsampledRows& rows,
+                    DecodeStats* stats);
 
-    void Norm(std::vector<int32_t>& table);
+    // Copies the rows of the planes of the channels from the same row of MCU to the planar
+    // image.
+    void OutputPlanarRows(size_t row, size_t mcu_hieght, size_t plane_row);
 };
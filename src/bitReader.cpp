@@ -1,17 +1,51 @@
 #include "bitReader.h"
 #include <glog/logging.h>
+#include <algorithm>
 #include <cstdint>
+#include <cstring>
 #include <stdexcept>
 #include "cons.h"
 
-BitReader::BitReader(std::istream& istream) : istream_(istream), bit_(0), used_bits_(kByteSize) {
+namespace {
+
+constexpr size_t kInputSize = 1 << 16;
+
+constexpr size_t kBufferSize = 64;
+
+}  // namespace
+
+BitReader::BitReader(std::istream& istream)
+    : istream_(&istream),
+      storage_(kInputSize),
+      input_(storage_.data()),
+      input_pos_(0),
+      input_end_(0),
+      loaded_(0),
+      buffer_(0),
+      buffer_size_(0),
+      marker_(0),
+      marker_bytes_(0),
+      padding_(0) {
+}
+
+BitReader::BitReader(const uint8_t* data, size_t size)
+    : istream_(nullptr),
+      input_(data),
+      input_pos_(0),
+      input_end_(size),
+      loaded_(0),
+      buffer_(0),
+      buffer_size_(0),
+      marker_(0),
+      marker_bytes_(0),
+      padding_(0) {
 }
 
 uint8_t BitReader::ReadByte() {
-    // if (used_bits_ != kByteSize) {  TODO: maybe need
-    //     DLOG(ERROR) << "Try to read byte before read all buffer\n";
-    //     throw std::runtime_error("");
-    // }
+    if (marker_bytes_ != 0) {
+        --marker_bytes_;
+        return static_cast<uint8_t>(marker_ >> (kByteSize * marker_bytes_));
+    }
     return Read();
 }
 
@@ -19,34 +53,215 @@ uint16_t BitReader::ReadTwoBytes() {
     return (static_cast<uint16_t>(ReadByte()) << kByteSize) + ReadByte();
 }
 
-bool BitReader::ReadBit() {
-    if (used_bits_ == kByteSize) {
-        bit_ = Read();
-        if (bit_ == 0xff) {
-            if (Read() != 0) {
-                throw std::runtime_error("Wrong byte after 0xff\n");
+void BitReader::ReadBytes(uint8_t* data, size_t count) {
+    for (; count != 0 && marker_bytes_ != 0; --count) {
+        *data++ = ReadByte();
+    }
+    while (count != 0) {
+        if (input_pos_ == input_end_ && !LoadInput()) {
+            DLOG(ERROR) << "Read after reach end of file\n";
+            throw std::runtime_error("");
+        }
+        size_t chunk = std::min(count, input_end_ - input_pos_);
+        std::memcpy(data, input_ + input_pos_, chunk);
+        input_pos_ += chunk;
+        data += chunk;
+        count -= chunk;
+    }
+}
+
+void BitReader::SkipBytes(size_t count) {
+    for (; count != 0 && marker_bytes_ != 0; --count) {
+        ReadByte();
+    }
+    while (count != 0) {
+        if (input_pos_ == input_end_ && !LoadInput()) {
+            DLOG(ERROR) << "Read after reach end of file\n";
+            throw std::runtime_error("");
+        }
+        size_t chunk = std::min(count, input_end_ - input_pos_);
+        input_pos_ += chunk;
+        count -= chunk;
+    }
+}
+
+uint32_t BitReader::PeekBits(size_t count) {
+    if (buffer_size_ < count) {
+        Fill();
+    }
+    return static_cast<uint32_t>(buffer_ >> (kBufferSize - count));
+}
+
+void BitReader::SkipBits(size_t count) {
+    if (buffer_size_ < count) {
+        Fill();
+    }
+    buffer_ <<= count;
+    buffer_size_ -= count;
+}
+
+uint32_t BitReader::GetBits(size_t count) {
+    if (count == 0) {
+        return 0;
+    }
+    uint32_t bits = PeekBits(count);
+    SkipBits(count);
+    return bits;
+}
+
+void BitReader::ResetBits() {
+    buffer_ = 0;
+    buffer_size_ = 0;
+    padding_ = 0;
+}
+
+void BitReader::ReadSegment(std::vector<uint8_t>& segment, std::vector<size_t>& restarts) {
+    segment.clear();
+    restarts.assign(1, 0);
+
+    while (true) {
+        if (input_pos_ == input_end_ && !LoadInput()) {
+            DLOG(ERROR) << "Read after reach end of file\n";
+            throw std::runtime_error("");
+        }
+
+        const uint8_t* begin = input_ + input_pos_;
+        const void* found = std::memchr(begin, 0xff, input_end_ - input_pos_);
+        size_t chunk = found == nullptr ? input_end_ - input_pos_
+                                        : static_cast<const uint8_t*>(found) - begin;
+        segment.insert(segment.end(), begin, begin + chunk);
+        input_pos_ += chunk;
+        if (found == nullptr) {
+            continue;
+        }
+
+        ++input_pos_;
+        uint8_t next = Read();
+        if (next == 0) {
+            segment.push_back(0xff);
+            segment.push_back(0);
+        } else if (next >= (kMarkerRST0 & 0xff) && next <= (kMarkerRST7 & 0xff)) {
+            if (next != (kMarkerRST0 & 0xff) + (restarts.size() - 1) % kRestartMarkerNum) {
+                DLOG(ERROR) << "Wrong restart marker\n";
+                throw std::runtime_error("Wrong restart marker\n");
             }
+            restarts.push_back(segment.size());
+        } else {
+            marker_ = (static_cast<uint16_t>(0xff) << kByteSize) + next;
+            marker_bytes_ = 2;
+            return;
         }
-        used_bits_ = 0;
     }
-    uint8_t cur = bit_ >> (kByteSize - 1);
-    bit_ <<= 1;
-    // uint8_t cur = bit_;
-    // bit_ >>= 1;
-    ++used_bits_;
-    return cur & 1;
+}
+
+void BitReader::Append(const uint8_t* data, size_t size) {
+    // Read bytes are dropped once they take half of the storage, so small appends do not move
+    // the rest each time.
+    if (input_pos_ > storage_.size() / 2) {
+        storage_.erase(storage_.begin(), storage_.begin() + input_pos_);
+        loaded_ += input_pos_;
+        input_end_ -= input_pos_;
+        input_pos_ = 0;
+    }
+    storage_.insert(storage_.end(), data, data + size);
+    input_ = storage_.data();
+    input_end_ += size;
+}
+
+size_t BitReader::Available() const {
+    return marker_bytes_ + input_end_ - input_pos_;
+}
+
+uint8_t BitReader::PeekByte(size_t offset) const {
+    if (offset < marker_bytes_) {
+        return static_cast<uint8_t>(marker_ >> (kByteSize * (marker_bytes_ - offset - 1)));
+    }
+    return input_[input_pos_ + offset - marker_bytes_];
+}
+
+BitReader::State BitReader::Save() {
+    buffer_size_ -= padding_ * kByteSize;
+    padding_ = 0;
+    return {input_pos_, buffer_, buffer_size_, marker_, marker_bytes_, padding_};
+}
+
+void BitReader::Restore(const State& state) {
+    input_pos_ = state.input_pos;
+    buffer_ = state.buffer;
+    buffer_size_ = state.buffer_size;
+    marker_ = state.marker;
+    marker_bytes_ = state.marker_bytes;
+    padding_ = state.padding;
+}
+
+bool BitReader::IsPastEnd() const {
+    return buffer_size_ < padding_ * kByteSize;
+}
+
+bool BitReader::IsAtEnd() const {
+    return padding_ != 0 || (marker_bytes_ == 0 && input_pos_ == input_end_);
 }
 
 bool BitReader::IsEnd() {
-    return istream_.eof();
+    return input_pos_ == input_end_ && !LoadInput();
+}
+
+size_t BitReader::Position() const {
+    return loaded_ + input_pos_ - marker_bytes_;
+}
+
+bool BitReader::LoadInput() {
+    if (istream_ == nullptr || !*istream_) {
+        return false;
+    }
+    loaded_ += input_end_;
+    istream_->read(reinterpret_cast<char*>(storage_.data()), storage_.size());
+    input_ = storage_.data();
+    input_pos_ = 0;
+    input_end_ = static_cast<size_t>(istream_->gcount());
+    return input_end_ != 0;
+}
+
+void BitReader::Fill() {
+    size_t count = (kBufferSize - buffer_size_) / kByteSize;
+
+    // Fast path: none of the next bytes can start a stuffed byte or a marker.
+    if (marker_bytes_ == 0 && input_end_ - input_pos_ >= count &&
+        std::memchr(input_ + input_pos_, 0xff, count) == nullptr) {
+        const uint8_t* data = input_ + input_pos_;
+        for (size_t i = 0; i < count; ++i) {
+            buffer_ |= static_cast<uint64_t>(data[i])
+                       << (kBufferSize - kByteSize - buffer_size_);
+            buffer_size_ += kByteSize;
+        }
+        input_pos_ += count;
+        return;
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        uint8_t byte = 0;
+        if (marker_bytes_ == 0 && !IsEnd()) {
+            byte = Read();
+            if (byte == 0xff) {
+                uint8_t next = Read();
+                if (next != 0) {
+                    marker_ = (static_cast<uint16_t>(byte) << kByteSize) + next;
+                    marker_bytes_ = 2;
+                    byte = 0;
+                }
+            }
+        } else if (marker_bytes_ == 0) {
+            ++padding_;
+        }
+        buffer_ |= static_cast<uint64_t>(byte) << (kBufferSize - kByteSize - buffer_size_);
+        buffer_size_ += kByteSize;
+    }
 }
 
 uint8_t BitReader::Read() {
-    if (IsEnd()) {
+    if (input_pos_ == input_end_ && !LoadInput()) {
         DLOG(ERROR) << "Read after reach end of file\n";
         throw std::runtime_error("");
     }
-    char cur = 0;
-    istream_.read(&cur, 1);
-    return static_cast<uint8_t>(cur);
+    return input_[input_pos_++];
 }
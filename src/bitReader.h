@@ -1,26 +1,103 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 #include <istream>
+#include <vector>
 
 class BitReader {
 public:
+    // Position in the input and the buffered bits, see Save.
+    struct State {
+        size_t input_pos = 0;
+        uint64_t buffer = 0;
+        size_t buffer_size = 0;
+        uint16_t marker = 0;
+        size_t marker_bytes = 0;
+        size_t padding = 0;
+    };
+
     BitReader() = delete;
 
     BitReader(std::istream& istream);
 
+    // Reads |size| bytes of |data|, which must outlive the reader. Readers created with no
+    // data read the bytes passed to Append.
+    BitReader(const uint8_t* data, size_t size);
+
+    // Copies |size| bytes of |data| to the end of the input of a reader created with no data.
+    // Bytes before the current position may be dropped, states saved before are invalidated.
+    void Append(const uint8_t* data, size_t size);
+
+    // Bytes that can be read before the end of the input.
+    size_t Available() const;
+
+    // Returns the byte |offset| bytes after the current position without reading it.
+    uint8_t PeekByte(size_t offset) const;
+
+    // Drops the zeros padded past the end of the input, which must not have been read, and
+    // returns the state to return to with Restore if the input runs out.
+    State Save();
+
+    void Restore(const State& state);
+
+    // Entropy-coded data ran past the end of the input: the bits read include the zeros
+    // padded after it.
+    bool IsPastEnd() const;
+
+    // Everything up to the end of the input was read or padded.
+    bool IsAtEnd() const;
+
     uint8_t ReadByte();
 
     uint16_t ReadTwoBytes();
 
-    bool ReadBit();
+    // Copies next |count| bytes to |data|.
+    void ReadBytes(uint8_t* data, size_t count);
+
+    void SkipBytes(size_t count);
+
+    // Returns next |count| (no more than 32) bits of entropy-coded data without consuming them.
+    // Stuffed zero bytes are skipped, after a marker the data is padded with zeros.
+    uint32_t PeekBits(size_t count);
+
+    void SkipBits(size_t count);
+
+    uint32_t GetBits(size_t count);
+
+    // Drops buffered bits at the end of entropy-coded segment, next ReadByte returns
+    // the marker that ended it.
+    void ResetBits();
+
+    // Copies entropy-coded data up to the first marker other than RSTn into |segment| as is,
+    // |restarts| receives the offset of each restart interval in it. Next ReadByte returns
+    // the marker that ended the data.
+    void ReadSegment(std::vector<uint8_t>& segment, std::vector<size_t>& restarts);
 
     bool IsEnd();
 
+    // Number of bytes taken from the source so far, bits read ahead included.
+    size_t Position() const;
+
 private:
-    std::istream& istream_;
-    uint8_t bit_;
-    uint8_t used_bits_;
+    std::istream* istream_;
+    std::vector<uint8_t> storage_;
+    const uint8_t* input_;
+    size_t input_pos_;
+    size_t input_end_;
+    // Bytes of the stream loaded before input_.
+    size_t loaded_;
+    uint64_t buffer_;
+    size_t buffer_size_;
+    uint16_t marker_;
+    size_t marker_bytes_;
+    // Zero bytes added to buffer_ past the end of the input rather than after a marker.
+    size_t padding_;
 
     uint8_t Read();
+
+    // Reads next chunk of the stream into input_, returns false if the stream is over.
+    bool LoadInput();
+
+    void Fill();
 };
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "cons.h"
+#include "header.h"
+
+// Quantized DCT coefficients of one component, as they are stored in the file.
+struct CoefficientPlane {
+    Sampling sampling;
+    // Blocks cover whole MCU, so the grid may extend past the edge of the image.
+    size_t width_in_blocks = 0;
+    size_t height_in_blocks = 0;
+    // Quantization table of the component in natural order.
+    std::array<uint16_t, kTableSize> quant_table{};
+    // kTableSize coefficients of each block in natural order, blocks go row by row.
+    std::vector<int16_t> coefficients;
+
+    const int16_t* Block(size_t row, size_t column) const {
+        return coefficients.data() + (row * width_in_blocks + column) * kTableSize;
+    }
+};
+
+// Coefficients of a whole image, components are in the order of the frame header.
+struct CoefficientImage {
+    size_t width = 0;
+    size_t height = 0;
+    std::vector<CoefficientPlane> components;
+    std::string comment;
+};
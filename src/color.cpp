@@ -0,0 +1,272 @@
+#include "color.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include "cons.h"
+
+#ifdef JPEG_DECODER_SSE2
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#endif
+
+namespace {
+
+// JFIF coefficients scaled by 2^kColorBits:
+// R = Y + 1.402 Cr, G = Y - 0.34414 Cb - 0.71414 Cr, B = Y + 1.772 Cb.
+constexpr int32_t kColorBits = 14;
+constexpr int32_t kCrToR = 22970;
+constexpr int32_t kCbToG = -5638;
+constexpr int32_t kCrToG = -11700;
+constexpr int32_t kCbToB = 29032;
+
+constexpr int32_t kCenter = 128;
+
+constexpr size_t kColors = 256;
+
+struct ColorTables {
+    std::array<int32_t, kColors> cr_to_r{};
+    std::array<int32_t, kColors> cb_to_b{};
+    // Unshifted products, rounding term is included into cr_to_g.
+    std::array<int32_t, kColors> cb_to_g{};
+    std::array<int32_t, kColors> cr_to_g{};
+};
+
+constexpr ColorTables MakeColorTables() {
+    ColorTables tables;
+    constexpr int32_t round = 1 << (kColorBits - 1);
+    for (int32_t i = 0; i < static_cast<int32_t>(kColors); ++i) {
+        int32_t value = i - kCenter;
+        tables.cr_to_r[i] = (kCrToR * value + round) >> kColorBits;
+        tables.cb_to_b[i] = (kCbToB * value + round) >> kColorBits;
+        tables.cb_to_g[i] = kCbToG * value;
+        tables.cr_to_g[i] = kCrToG * value + round;
+    }
+    return tables;
+}
+
+constexpr ColorTables kTables = MakeColorTables();
+
+inline uint8_t Clamp(int32_t value) {
+    return static_cast<uint8_t>(value < 0 ? 0 : value > 255 ? 255 : value);
+}
+
+inline void ConvertPixel(uint8_t y, uint8_t cb, uint8_t cr, uint8_t* output) {
+    output[0] = Clamp(y + kTables.cr_to_r[cr]);
+    output[1] = Clamp(y + ((kTables.cb_to_g[cb] + kTables.cr_to_g[cr]) >> kColorBits));
+    output[2] = Clamp(y + kTables.cb_to_b[cb]);
+}
+
+#ifdef JPEG_DECODER_SSE2
+
+constexpr size_t kVectorPixels = 16;
+
+bool HasSSE2() {
+    return __builtin_cpu_supports("sse2");
+}
+
+bool HasSSSE3() {
+    return __builtin_cpu_supports("ssse3");
+}
+
+// Adds the chroma term of 8 pixels to 16-bit |y|, the term is computed as in the scalar
+// tables: (first * cb + second * cr + round) >> kColorBits.
+__attribute__((target("sse2"))) inline __m128i AddChroma(__m128i y, __m128i cb, __m128i cr,
+                                                         int32_t first, int32_t second) {
+    __m128i factors = _mm_set_epi16(second, first, second, first, second, first, second, first);
+    __m128i round = _mm_set1_epi32(1 << (kColorBits - 1));
+    __m128i lo = _mm_madd_epi16(_mm_unpacklo_epi16(cb, cr), factors);
+    __m128i hi = _mm_madd_epi16(_mm_unpackhi_epi16(cb, cr), factors);
+    lo = _mm_srai_epi32(_mm_add_epi32(lo, round), kColorBits);
+    hi = _mm_srai_epi32(_mm_add_epi32(hi, round), kColorBits);
+    return _mm_add_epi16(y, _mm_packs_epi32(lo, hi));
+}
+
+// Converts 16 pixels into planar |r|, |g| and |b|.
+__attribute__((target("sse2"))) inline void ConvertVector(const uint8_t* y, const uint8_t* cb,
+                                                          const uint8_t* cr, __m128i& r,
+                                                          __m128i& g, __m128i& b) {
+    __m128i zero = _mm_setzero_si128();
+    __m128i center = _mm_set1_epi16(kCenter);
+    __m128i y_vec = _mm_loadu_si128(reinterpret_cast<const __m128i*>(y));
+    __m128i cb_vec = _mm_loadu_si128(reinterpret_cast<const __m128i*>(cb));
+    __m128i cr_vec = _mm_loadu_si128(reinterpret_cast<const __m128i*>(cr));
+
+    __m128i y_lo = _mm_unpacklo_epi8(y_vec, zero);
+    __m128i y_hi = _mm_unpackhi_epi8(y_vec, zero);
+    __m128i cb_lo = _mm_sub_epi16(_mm_unpacklo_epi8(cb_vec, zero), center);
+    __m128i cb_hi = _mm_sub_epi16(_mm_unpackhi_epi8(cb_vec, zero), center);
+    __m128i cr_lo = _mm_sub_epi16(_mm_unpacklo_epi8(cr_vec, zero), center);
+    __m128i cr_hi = _mm_sub_epi16(_mm_unpackhi_epi8(cr_vec, zero), center);
+
+    r = _mm_packus_epi16(AddChroma(y_lo, cb_lo, cr_lo, 0, kCrToR),
+                         AddChroma(y_hi, cb_hi, cr_hi, 0, kCrToR));
+    g = _mm_packus_epi16(AddChroma(y_lo, cb_lo, cr_lo, kCbToG, kCrToG),
+                         AddChroma(y_hi, cb_hi, cr_hi, kCbToG, kCrToG));
+    b = _mm_packus_epi16(AddChroma(y_lo, cb_lo, cr_lo, kCbToB, 0),
+                         AddChroma(y_hi, cb_hi, cr_hi, kCbToB, 0));
+}
+
+// Interleaves 16 pixels into four vectors of RGBA quadruples.
+__attribute__((target("sse2"))) inline void Interleave(__m128i r, __m128i g, __m128i b,
+                                                       __m128i a, __m128i* rgba) {
+    __m128i rg_lo = _mm_unpacklo_epi8(r, g);
+    __m128i rg_hi = _mm_unpackhi_epi8(r, g);
+    __m128i ba_lo = _mm_unpacklo_epi8(b, a);
+    __m128i ba_hi = _mm_unpackhi_epi8(b, a);
+    rgba[0] = _mm_unpacklo_epi16(rg_lo, ba_lo);
+    rgba[1] = _mm_unpackhi_epi16(rg_lo, ba_lo);
+    rgba[2] = _mm_unpacklo_epi16(rg_hi, ba_hi);
+    rgba[3] = _mm_unpackhi_epi16(rg_hi, ba_hi);
+}
+
+#endif
+
+}  // namespace
+
+ColorConverter GetColorConverter(PixelFormat format) {
+    if (format == PixelFormat::kGray8) {
+        return YCbCrToGray8;
+    }
+#ifdef JPEG_DECODER_SSE2
+    if (format == PixelFormat::kRGB8 && HasSSSE3()) {
+        return YCbCrToRGB8SSSE3;
+    } else if (format == PixelFormat::kRGBA8 && HasSSE2()) {
+        return YCbCrToRGBA8SSE2;
+    }
+#endif
+    if (format == PixelFormat::kRGBA8) {
+        return YCbCrToRGBA8;
+    }
+    return YCbCrToRGB8;
+}
+
+ColorConverter GetGrayConverter(PixelFormat format) {
+    if (format == PixelFormat::kGray8) {
+        return YCbCrToGray8;
+    }
+#ifdef JPEG_DECODER_SSE2
+    if (format == PixelFormat::kRGB8 && HasSSSE3()) {
+        return GrayToRGB8SSSE3;
+    } else if (format == PixelFormat::kRGBA8 && HasSSE2()) {
+        return GrayToRGBA8SSE2;
+    }
+#endif
+    if (format == PixelFormat::kRGBA8) {
+        return GrayToRGBA8;
+    }
+    return GrayToRGB8;
+}
+
+void YCbCrToRGB8(const uint8_t* y, const uint8_t* cb, const uint8_t* cr, uint8_t* output,
+                 size_t width) {
+    for (size_t i = 0; i < width; ++i, output += 3) {
+        ConvertPixel(y[i], cb[i], cr[i], output);
+    }
+}
+
+void YCbCrToRGBA8(const uint8_t* y, const uint8_t* cb, const uint8_t* cr, uint8_t* output,
+                  size_t width) {
+    for (size_t i = 0; i < width; ++i, output += 4) {
+        ConvertPixel(y[i], cb[i], cr[i], output);
+        output[3] = 255;
+    }
+}
+
+void YCbCrToGray8(const uint8_t* y, const uint8_t*, const uint8_t*, uint8_t* output,
+                  size_t width) {
+    std::memcpy(output, y, width);
+}
+
+void GrayToRGB8(const uint8_t* y, const uint8_t*, const uint8_t*, uint8_t* output,
+                size_t width) {
+    for (size_t i = 0; i < width; ++i, output += 3) {
+        output[0] = output[1] = output[2] = y[i];
+    }
+}
+
+void GrayToRGBA8(const uint8_t* y, const uint8_t*, const uint8_t*, uint8_t* output,
+                 size_t width) {
+    for (size_t i = 0; i < width; ++i, output += 4) {
+        output[0] = output[1] = output[2] = y[i];
+        output[3] = 255;
+    }
+}
+
+#ifdef JPEG_DECODER_SSE2
+
+__attribute__((target("ssse3"))) void YCbCrToRGB8SSSE3(const uint8_t* y, const uint8_t* cb,
+                                                       const uint8_t* cr, uint8_t* output,
+                                                       size_t width) {
+    // Drops every fourth byte of RGBA quadruples, the last four bytes become zero.
+    __m128i pack = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    size_t i = 0;
+    for (; i + kVectorPixels <= width; i += kVectorPixels, output += 3 * kVectorPixels) {
+        __m128i r, g, b;
+        __m128i rgba[4];
+        ConvertVector(y + i, cb + i, cr + i, r, g, b);
+        Interleave(r, g, b, _mm_setzero_si128(), rgba);
+        for (auto& vector : rgba) {
+            vector = _mm_shuffle_epi8(vector, pack);
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(output),
+                         _mm_or_si128(rgba[0], _mm_slli_si128(rgba[1], 12)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(output + 16),
+                         _mm_or_si128(_mm_srli_si128(rgba[1], 4), _mm_slli_si128(rgba[2], 8)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(output + 32),
+                         _mm_or_si128(_mm_srli_si128(rgba[2], 8), _mm_slli_si128(rgba[3], 4)));
+    }
+    YCbCrToRGB8(y + i, cb + i, cr + i, output, width - i);
+}
+
+__attribute__((target("sse2"))) void YCbCrToRGBA8SSE2(const uint8_t* y, const uint8_t* cb,
+                                                      const uint8_t* cr, uint8_t* output,
+                                                      size_t width) {
+    __m128i alpha = _mm_set1_epi8(-1);
+    size_t i = 0;
+    for (; i + kVectorPixels <= width; i += kVectorPixels, output += 4 * kVectorPixels) {
+        __m128i r, g, b;
+        __m128i rgba[4];
+        ConvertVector(y + i, cb + i, cr + i, r, g, b);
+        Interleave(r, g, b, alpha, rgba);
+        for (size_t k = 0; k < 4; ++k) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(output) + k, rgba[k]);
+        }
+    }
+    YCbCrToRGBA8(y + i, cb + i, cr + i, output, width - i);
+}
+
+__attribute__((target("ssse3"))) void GrayToRGB8SSSE3(const uint8_t* y, const uint8_t* cb,
+                                                      const uint8_t* cr, uint8_t* output,
+                                                      size_t width) {
+    // Byte k of the 48 output bytes of 16 pixels is y[k / 3].
+    __m128i first = _mm_setr_epi8(0, 0, 0, 1, 1, 1, 2, 2, 2, 3, 3, 3, 4, 4, 4, 5);
+    __m128i second = _mm_setr_epi8(5, 5, 6, 6, 6, 7, 7, 7, 8, 8, 8, 9, 9, 9, 10, 10);
+    __m128i third = _mm_setr_epi8(10, 11, 11, 11, 12, 12, 12, 13, 13, 13, 14, 14, 14, 15, 15, 15);
+    size_t i = 0;
+    for (; i + kVectorPixels <= width; i += kVectorPixels, output += 3 * kVectorPixels) {
+        __m128i gray = _mm_loadu_si128(reinterpret_cast<const __m128i*>(y + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(output), _mm_shuffle_epi8(gray, first));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(output + 16), _mm_shuffle_epi8(gray, second));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(output + 32), _mm_shuffle_epi8(gray, third));
+    }
+    GrayToRGB8(y + i, cb, cr, output, width - i);
+}
+
+__attribute__((target("sse2"))) void GrayToRGBA8SSE2(const uint8_t* y, const uint8_t* cb,
+                                                     const uint8_t* cr, uint8_t* output,
+                                                     size_t width) {
+    __m128i alpha = _mm_set1_epi8(-1);
+    size_t i = 0;
+    for (; i + kVectorPixels <= width; i += kVectorPixels, output += 4 * kVectorPixels) {
+        __m128i gray = _mm_loadu_si128(reinterpret_cast<const __m128i*>(y + i));
+        __m128i rgba[4];
+        Interleave(gray, gray, gray, alpha, rgba);
+        for (size_t k = 0; k < 4; ++k) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(output) + k, rgba[k]);
+        }
+    }
+    GrayToRGBA8(y + i, cb, cr, output, width - i);
+}
+
+#endif
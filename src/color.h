@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "cons.h"
+#include "image.h"
+
+// Converts |width| pixels of full resolution Y, Cb and Cr rows into packed |output|.
+using ColorConverter = void (*)(const uint8_t* y, const uint8_t* cb, const uint8_t* cr,
+                                uint8_t* output, size_t width);
+
+// Returns the fastest converter to |format| supported by the CPU.
+ColorConverter GetColorConverter(PixelFormat format);
+
+// Same for images with only the Y channel, the chroma rows are not read and may be nullptr.
+ColorConverter GetGrayConverter(PixelFormat format);
+
+void YCbCrToRGB8(const uint8_t* y, const uint8_t* cb, const uint8_t* cr, uint8_t* output,
+                 size_t width);
+
+void YCbCrToRGBA8(const uint8_t* y, const uint8_t* cb, const uint8_t* cr, uint8_t* output,
+                  size_t width);
+
+void YCbCrToGray8(const uint8_t* y, const uint8_t* cb, const uint8_t* cr, uint8_t* output,
+                  size_t width);
+
+// Replicate Y to every color, same results as the converters above with neutral chroma.
+void GrayToRGB8(const uint8_t* y, const uint8_t* cb, const uint8_t* cr, uint8_t* output,
+                size_t width);
+
+void GrayToRGBA8(const uint8_t* y, const uint8_t* cb, const uint8_t* cr, uint8_t* output,
+                 size_t width);
+
+#ifdef JPEG_DECODER_SSE2
+// Same results as the scalar converters, 16 pixels per iteration. RGB8 needs SSSE3 to pack
+// pixels into three bytes.
+void YCbCrToRGB8SSSE3(const uint8_t* y, const uint8_t* cb, const uint8_t* cr, uint8_t* output,
+                      size_t width);
+
+void YCbCrToRGBA8SSE2(const uint8_t* y, const uint8_t* cb, const uint8_t* cr, uint8_t* output,
+                      size_t width);
+
+void GrayToRGB8SSSE3(const uint8_t* y, const uint8_t* cb, const uint8_t* cr, uint8_t* output,
+                     size_t width);
+
+void GrayToRGBA8SSE2(const uint8_t* y, const uint8_t* cb, const uint8_t* cr, uint8_t* output,
+                     size_t width);
+#endif
@@ -4,6 +4,10 @@
 #include <cstddef>
 #include <cstdint>
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define JPEG_DECODER_SSE2
+#endif
+
 using MarkerType = uint16_t;
 
 constexpr size_t kChannelNum = 3;
@@ -26,6 +30,8 @@ constexpr MarkerType kMarkerEnd = 0xffd9;
 
 constexpr MarkerType kMarkerSOF0 = 0xffc0;
 
+constexpr MarkerType kMarkerSOF2 = 0xffc2;
+
 constexpr MarkerType kMarkerDHT = 0xffc4;
 
 constexpr MarkerType kMarkerDQT = 0xffdb;
@@ -38,6 +44,14 @@ constexpr MarkerType kMarkerCOM = 0xfffe;
 
 constexpr MarkerType kMarkerSOS = 0xffda;
 
+constexpr MarkerType kMarkerDRI = 0xffdd;
+
+constexpr MarkerType kMarkerRST0 = 0xffd0;
+
+constexpr MarkerType kMarkerRST7 = 0xffd7;
+
+constexpr size_t kRestartMarkerNum = 8;
+
 constexpr MarkerType k00 = 0x00;
 constexpr MarkerType k01 = 0x01;
 constexpr MarkerType k10 = 0x10;
@@ -1,23 +1,364 @@
 #include <decoder.h>
 #include <glog/logging.h>
+#include <algorithm>
 #include <cstdint>
+#include <stdexcept>
 
 #include "cons.h"
 #include "markers.h"
 #include "JPEGDecoder.h"
+#include "mappedFile.h"
+#include "threadPool.h"
 
-Image Decode(std::istream& input) {
-    JPEGDecoder decoder(input);
+namespace {
+
+void DecodeMarkers(JPEGDecoder& decoder) {
+    JPEG_DECODER_STATS_ONLY(StageClock total(decoder.GetStats());)
     MarkerType marker = decoder.GetMarker();
 
     CheckStartMarker(marker);
 
     while (decoder.IsDecoding()) {
         marker = decoder.GetMarker();
+        // Scans and the rendering at the end are counted by their stages.
+        JPEG_DECODER_STATS_ONLY(StageClock clock(
+            marker == kMarkerSOS || marker == kMarkerEnd ? nullptr : decoder.GetStats());)
+        ProcessMarker(marker, decoder);
+        JPEG_DECODER_STATS_ONLY(clock.Lap(&DecodeStats::marker_ns);)
+    }
+
+    if (!decoder.IsStopped()) {
+        CheckEndMarker(marker);
+    }
+    JPEG_DECODER_STATS_ONLY(if (decoder.GetStats() != nullptr) {
+        total.Lap(&DecodeStats::total_ns);
+        decoder.GetStats()->bytes = decoder.GetPosition();
+    })
+}
+
+Image DecodeImage(JPEGDecoder& decoder) {
+    DecodeMarkers(decoder);
+    return decoder.TakeImage();
+}
+
+std::string DecodeImageRows(JPEGDecoder& decoder, const RowCallback& callback) {
+    decoder.SetRowCallback(callback);
+    DecodeMarkers(decoder);
+    return decoder.GetImage().GetComment();
+}
+
+PlanarImage DecodeImagePlanes(JPEGDecoder& decoder) {
+    decoder.SetPlanarOutput();
+    DecodeMarkers(decoder);
+    return decoder.TakePlanarImage();
+}
+
+CoefficientImage DecodeImageCoefficients(JPEGDecoder& decoder) {
+    decoder.SetCoefficientOutput();
+    DecodeMarkers(decoder);
+    return decoder.TakeCoefficients();
+}
+
+ImageHeader ProbeHeader(JPEGDecoder& decoder) {
+    CheckStartMarker(decoder.GetMarker());
+
+    MarkerType marker = decoder.GetMarker();
+    while (marker != kMarkerSOS) {
+        if (marker == kMarkerEnd) {
+            DLOG(ERROR) << "No scans\n";
+            throw std::runtime_error("No scans\n");
+        }
         ProcessMarker(marker, decoder);
+        marker = decoder.GetMarker();
+    }
+
+    if (!decoder.IsSizeSet()) {
+        DLOG(ERROR) << "Empty Image\n";
+        throw std::runtime_error("Empty Image\n");
+    }
+    return decoder.GetHeader();
+}
+
+}  // namespace
+
+Image Decode(std::istream& input, const DecodeOptions& options) {
+    JPEGDecoder decoder(input, options);
+    return DecodeImage(decoder);
+}
+
+Image Decode(const uint8_t* data, size_t size, const DecodeOptions& options) {
+    JPEGDecoder decoder(data, size, options);
+    return DecodeImage(decoder);
+}
+
+std::string DecodeRows(std::istream& input, const RowCallback& callback,
+                       const DecodeOptions& options) {
+    JPEGDecoder decoder(input, options);
+    return DecodeImageRows(decoder, callback);
+}
+
+std::string DecodeRows(const uint8_t* data, size_t size, const RowCallback& callback,
+                       const DecodeOptions& options) {
+    JPEGDecoder decoder(data, size, options);
+    return DecodeImageRows(decoder, callback);
+}
+
+PlanarImage DecodeYCbCr(std::istream& input, const DecodeOptions& options) {
+    JPEGDecoder decoder(input, options);
+    return DecodeImagePlanes(decoder);
+}
+
+PlanarImage DecodeYCbCr(const uint8_t* data, size_t size, const DecodeOptions& options) {
+    JPEGDecoder decoder(data, size, options);
+    return DecodeImagePlanes(decoder);
+}
+
+CoefficientImage DecodeCoefficients(std::istream& input) {
+    JPEGDecoder decoder(input);
+    return DecodeImageCoefficients(decoder);
+}
+
+CoefficientImage DecodeCoefficients(const uint8_t* data, size_t size) {
+    JPEGDecoder decoder(data, size);
+    return DecodeImageCoefficients(decoder);
+}
+
+Image DecodeFile(const std::string& path, const DecodeOptions& options) {
+    MappedFile file(path);
+    return Decode(file.Data(), file.Size(), options);
+}
+
+DecoderContext::DecoderContext()
+    : decoder_(std::make_unique<JPEGDecoder>(static_cast<const uint8_t*>(nullptr), 0)) {
+}
+
+Image DecoderContext::Decode(std::istream& input, const DecodeOptions& options) {
+    decoder_->Reset(BitReader(input), options);
+    return DecodeImage(*decoder_);
+}
+
+Image DecoderContext::Decode(const uint8_t* data, size_t size, const DecodeOptions& options) {
+    decoder_->Reset(BitReader(data, size), options);
+    return DecodeImage(*decoder_);
+}
+
+std::string DecoderContext::DecodeRows(const uint8_t* data, size_t size,
+                                       const RowCallback& callback,
+                                       const DecodeOptions& options) {
+    decoder_->Reset(BitReader(data, size), options);
+    return DecodeImageRows(*decoder_, callback);
+}
+
+PlanarImage DecoderContext::DecodeYCbCr(const uint8_t* data, size_t size,
+                                        const DecodeOptions& options) {
+    decoder_->Reset(BitReader(data, size), options);
+    return DecodeImagePlanes(*decoder_);
+}
+
+CoefficientImage DecoderContext::DecodeCoefficients(const uint8_t* data, size_t size) {
+    decoder_->Reset(BitReader(data, size), DecodeOptions());
+    return DecodeImageCoefficients(*decoder_);
+}
+
+DecoderContext::~DecoderContext() = default;
+
+StreamDecoder::StreamDecoder(const DecodeOptions& options, RowCallback callback)
+    : decoder_(std::make_unique<JPEGDecoder>(static_cast<const uint8_t*>(nullptr), 0, options)) {
+    decoder_->SetIncrementalInput();
+    if (callback) {
+        decoder_->SetRowCallback(callback);
+    }
+}
+
+FeedStatus StreamDecoder::Feed(const uint8_t* data, size_t size) {
+    if (done_) {
+        return FeedStatus::kDone;
+    }
+    decoder_->AppendInput(data, size);
+    size_t rows = decoder_->GetRowsReady();
+
+    while (decoder_->IsDecoding()) {
+        if (decoder_->IsScanning()) {
+            if (!decoder_->TryDecodeRow()) {
+                break;
+            }
+            continue;
+        }
+        if (decoder_->GetAvailable() < 2) {
+            break;
+        }
+        if (!started_) {
+            CheckStartMarker(decoder_->GetMarker());
+            started_ = true;
+            continue;
+        }
+        MarkerType marker = (decoder_->PeekByte(0) << kByteSize) + decoder_->PeekByte(1);
+        if (marker == kMarkerSOS && !header_ready_) {
+            if (!decoder_->IsSizeSet()) {
+                DLOG(ERROR) << "Empty Image\n";
+                throw std::runtime_error("Empty Image\n");
+            }
+            header_ready_ = true;
+            return FeedStatus::kHeaderReady;
+        }
+        if (!IsSegmentBuffered()) {
+            break;
+        }
+        ProcessMarker(decoder_->GetMarker(), *decoder_);
+        scan_searched_ = 0;
+    }
+
+    // The last rows are reported before the end of the image.
+    if (decoder_->GetRowsReady() != rows) {
+        return FeedStatus::kRowsReady;
     }
+    if (!decoder_->IsDecoding()) {
+        done_ = true;
+        return FeedStatus::kDone;
+    }
+    return FeedStatus::kNeedMoreInput;
+}
+
+bool StreamDecoder::IsSegmentBuffered() {
+    size_t available = decoder_->GetAvailable();
+    MarkerType marker = (decoder_->PeekByte(0) << kByteSize) + decoder_->PeekByte(1);
+    if (marker == kMarkerEnd) {
+        return true;
+    }
+    if (available < 4) {
+        return false;
+    }
+    size_t end = 2 + ((decoder_->PeekByte(2) << kByteSize) + decoder_->PeekByte(3));
+    if (available < end) {
+        return false;
+    }
+    if (marker != kMarkerSOS || !decoder_->IsProgressive()) {
+        return true;
+    }
+    // The scan ends at the first marker other than RSTn, 0xff 0x00 is a stuffed byte and
+    // 0xff 0xff a fill byte.
+    for (size_t i = std::max(end, scan_searched_); i + 1 < available; ++i) {
+        if (decoder_->PeekByte(i) != 0xff) {
+            continue;
+        }
+        MarkerType next = 0xff00 + decoder_->PeekByte(i + 1);
+        if (next != 0xff00 && next != 0xffff && (next < kMarkerRST0 || next > kMarkerRST7)) {
+            return true;
+        }
+    }
+    scan_searched_ = std::max(end, available - 1);
+    return false;
+}
+
+const ImageHeader& StreamDecoder::GetHeader() const {
+    return decoder_->GetHeader();
+}
+
+const Image& StreamDecoder::GetImage() const {
+    return decoder_->GetImage();
+}
 
-    CheckEndMarker(marker);
+Image StreamDecoder::TakeImage() {
+    return decoder_->TakeImage();
+}
+
+size_t StreamDecoder::RowsReady() const {
+    return decoder_->GetRowsReady();
+}
+
+StreamDecoder::~StreamDecoder() = default;
+
+BatchDecoder::BatchDecoder(size_t threads)
+    : pool_(std::make_unique<ThreadPool>(std::max<size_t>(threads, 1))) {
+}
+
+std::future<Image> BatchDecoder::Submit(const uint8_t* data, size_t size,
+                                        const DecodeOptions& options) {
+    auto promise = std::make_shared<std::promise<Image>>();
+    std::future<Image> result = promise->get_future();
+    Submit(
+        data, size,
+        [promise](Image image, std::exception_ptr error) {
+            if (error) {
+                promise->set_exception(error);
+            } else {
+                promise->set_value(std::move(image));
+            }
+        },
+        options);
+    return result;
+}
+
+void BatchDecoder::Submit(const uint8_t* data, size_t size, Callback callback,
+                          const DecodeOptions& options) {
+    pool_->Submit([this, data, size, callback = std::move(callback), options] {
+        // A thread waiting for restart intervals may pick up another image, so decoders are
+        // taken per task rather than per thread.
+        JPEGDecoder* decoder = Acquire();
+        Image image;
+        std::exception_ptr error;
+        try {
+            decoder->Reset(BitReader(data, size), options);
+            image = DecodeImage(*decoder);
+        } catch (...) {
+            error = std::current_exception();
+        }
+        Release(decoder);
+        callback(std::move(image), error);
+    });
+}
+
+// pool_ is declared last, so it finishes the tasks before the decoders are destroyed. Tasks
+// still read pool_, it must not be reset before that.
+BatchDecoder::~BatchDecoder() = default;
+
+JPEGDecoder* BatchDecoder::Acquire() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (free_.empty()) {
+        decoders_.push_back(
+            std::make_unique<JPEGDecoder>(static_cast<const uint8_t*>(nullptr), 0));
+        decoders_.back()->SetThreadPool(pool_.get());
+        return decoders_.back().get();
+    }
+    JPEGDecoder* decoder = free_.back();
+    free_.pop_back();
+    return decoder;
+}
+
+void BatchDecoder::Release(JPEGDecoder* decoder) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    free_.push_back(decoder);
+}
+
+std::vector<Image> DecodeBatch(const std::vector<Span<const uint8_t>>& inputs, size_t threads,
+                               const DecodeOptions& options) {
+    std::vector<std::future<Image>> results;
+    results.reserve(inputs.size());
+    {
+        BatchDecoder batch(threads);
+        for (const auto& input : inputs) {
+            results.push_back(batch.Submit(input.data(), input.size(), options));
+        }
+    }
+    std::vector<Image> images;
+    images.reserve(results.size());
+    for (auto& result : results) {
+        images.push_back(result.get());
+    }
+    return images;
+}
+
+ImageHeader Probe(std::istream& input) {
+    JPEGDecoder decoder(input);
+    return ProbeHeader(decoder);
+}
+
+ImageHeader Probe(const uint8_t* data, size_t size) {
+    JPEGDecoder decoder(data, size);
+    return ProbeHeader(decoder);
+}
 
-    return decoder.GetImage();
+ImageHeader ProbeFile(const std::string& path) {
+    MappedFile file(path);
+    return Probe(file.Data(), file.Size());
 }
@@ -1,6 +1,184 @@
 #pragma once
 
+#include "coefficients.h"
+#include "header.h"
 #include "image.h"
+#include "options.h"
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <future>
 #include <istream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
 
-Image Decode(std::istream& input);
+Image Decode(std::istream& input, const DecodeOptions& options = DecodeOptions());
+
+// Decodes |size| bytes of |data| in place, without copying them.
+Image Decode(const uint8_t* data, size_t size, const DecodeOptions& options = DecodeOptions());
+
+// Decodes the file at |path| from its memory mapping.
+Image DecodeFile(const std::string& path, const DecodeOptions& options = DecodeOptions());
+
+// Passes each row of MCU to |callback| as soon as it is converted, without allocating the
+// image: memory is proportional to the width of the image (progressive images also keep
+// their coefficients). Restart intervals are decoded sequentially. Returns the comment of
+// the image.
+std::string DecodeRows(std::istream& input, const RowCallback& callback,
+                       const DecodeOptions& options = DecodeOptions());
+
+std::string DecodeRows(const uint8_t* data, size_t size, const RowCallback& callback,
+                       const DecodeOptions& options = DecodeOptions());
+
+// Decodes the Y, Cb and Cr channels at their own resolution, without upsampling or color
+// conversion. DecodeOptions::pixel_format is ignored.
+PlanarImage DecodeYCbCr(std::istream& input, const DecodeOptions& options = DecodeOptions());
+
+PlanarImage DecodeYCbCr(const uint8_t* data, size_t size,
+                        const DecodeOptions& options = DecodeOptions());
+
+// Reads the quantized DCT coefficients of all components without the inverse transform,
+// upsampling or color conversion, for transcoding and other lossless edits.
+CoefficientImage DecodeCoefficients(std::istream& input);
+
+CoefficientImage DecodeCoefficients(const uint8_t* data, size_t size);
+
+class JPEGDecoder;
+class ThreadPool;
+
+// Decoder kept between images: scratch buffers and the tables built from DHT and DQT
+// segments are reused, tables are looked up by the contents of the segments. Not thread-safe,
+// use one context per thread.
+class DecoderContext {
+public:
+    DecoderContext();
+
+    DecoderContext(const DecoderContext&) = delete;
+    DecoderContext& operator=(const DecoderContext&) = delete;
+
+    Image Decode(std::istream& input, const DecodeOptions& options = DecodeOptions());
+
+    Image Decode(const uint8_t* data, size_t size, const DecodeOptions& options = DecodeOptions());
+
+    std::string DecodeRows(const uint8_t* data, size_t size, const RowCallback& callback,
+                           const DecodeOptions& options = DecodeOptions());
+
+    PlanarImage DecodeYCbCr(const uint8_t* data, size_t size,
+                            const DecodeOptions& options = DecodeOptions());
+
+    CoefficientImage DecodeCoefficients(const uint8_t* data, size_t size);
+
+    ~DecoderContext();
+
+private:
+    std::unique_ptr<JPEGDecoder> decoder_;
+};
+
+// Result of StreamDecoder::Feed.
+enum class FeedStatus {
+    // All the input given so far is used, the decoder waits for the next bytes.
+    kNeedMoreInput,
+    // The markers before the first scan are read, GetHeader returns them.
+    kHeaderReady,
+    // RowsReady grew.
+    kRowsReady,
+    // The image is complete, the rest of the input is ignored. Comes after the kRowsReady of
+    // the last rows.
+    kDone,
+};
+
+// Decoder fed with the input as it arrives, for servers that can not block on a stream. Feed
+// returns as soon as it runs out of input and keeps only the bytes it has not used yet. Marker
+// segments and progressive scans are read once they are complete, baseline scans are decoded
+// MCU by MCU. DecodeOptions::threads is ignored. Throws std::runtime_error on invalid data,
+// the decoder can not be used after that.
+class StreamDecoder {
+public:
+    // Rows are passed to |callback| instead of being stored in the image if it is set.
+    explicit StreamDecoder(const DecodeOptions& options = DecodeOptions(),
+                           RowCallback callback = nullptr);
+
+    StreamDecoder(const StreamDecoder&) = delete;
+    StreamDecoder& operator=(const StreamDecoder&) = delete;
+
+    // Takes the next |size| bytes of the file. After kHeaderReady or kRowsReady call it with
+    // no data until it returns kNeedMoreInput or kDone, the bytes given may hold more.
+    FeedStatus Feed(const uint8_t* data, size_t size);
+
+    const ImageHeader& GetHeader() const;
+
+    // Image being decoded, the first RowsReady rows are final.
+    const Image& GetImage() const;
+
+    Image TakeImage();
+
+    // Rows of the image already decoded. Progressive images are converted all at once at the
+    // end.
+    size_t RowsReady() const;
+
+    ~StreamDecoder();
+
+private:
+    std::unique_ptr<JPEGDecoder> decoder_;
+    bool started_ = false;
+    bool header_ready_ = false;
+    bool done_ = false;
+    // Bytes after the header of the progressive scan searched for its end so far.
+    size_t scan_searched_ = 0;
+
+    // The input holds the whole next marker segment, and the scan after it for progressive
+    // images.
+    bool IsSegmentBuffered();
+};
+
+// Decodes independent images on a pool of threads. Idle threads steal queued images from busy
+// ones; with DecodeOptions::threads > 1 restart intervals of an image become tasks of the same
+// pool. Decoders and their tables are reused between images.
+class BatchDecoder {
+public:
+    // Receives the image, or the exception if decoding failed, on a thread of the pool.
+    using Callback = std::function<void(Image image, std::exception_ptr error)>;
+
+    explicit BatchDecoder(size_t threads);
+
+    BatchDecoder(const BatchDecoder&) = delete;
+    BatchDecoder& operator=(const BatchDecoder&) = delete;
+
+    // |data| must stay valid until the image is decoded.
+    std::future<Image> Submit(const uint8_t* data, size_t size,
+                              const DecodeOptions& options = DecodeOptions());
+
+    void Submit(const uint8_t* data, size_t size, Callback callback,
+                const DecodeOptions& options = DecodeOptions());
+
+    // Finishes all submitted images.
+    ~BatchDecoder();
+
+private:
+    std::vector<std::unique_ptr<JPEGDecoder>> decoders_;
+    // Decoders not used by any task.
+    std::vector<JPEGDecoder*> free_;
+    std::mutex mutex_;
+    std::unique_ptr<ThreadPool> pool_;
+
+    JPEGDecoder* Acquire();
+
+    void Release(JPEGDecoder* decoder);
+};
+
+// Decodes |inputs| on |threads| threads and returns the images in the order of inputs. Blocks
+// until all images are decoded, then throws the error of the first input that failed. The
+// threads live only for the call, BatchDecoder keeps them between batches and reports errors
+// per image.
+std::vector<Image> DecodeBatch(const std::vector<Span<const uint8_t>>& inputs, size_t threads,
+                               const DecodeOptions& options = DecodeOptions());
+
+// Reads the markers up to the first scan without decoding or allocating the image.
+ImageHeader Probe(std::istream& input);
+
+ImageHeader Probe(const uint8_t* data, size_t size);
+
+ImageHeader ProbeFile(const std::string& path);
@@ -0,0 +1,43 @@
+#include "entropy.h"
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <glog/logging.h>
+
+size_t ReadBlock(BitReader& reader, const HuffmanTree& dc, const HuffmanTree& ac,
+                 int32_t& last_value, int16_t* table, [[maybe_unused]] DecodeStats* stats) {
+    int32_t value = 0;
+
+    ReadCoef(reader, dc, value);
+    last_value += value;
+    table[0] = static_cast<int16_t>(last_value);
+
+    size_t last = 0;
+    size_t i = 1;
+    while (i < kTableSize) {
+        uint8_t coef = ReadCoef(reader, ac, value);
+
+        if (coef == 0) {
+            break;
+        }
+
+        JPEG_DECODER_STATS_ONLY(if (stats != nullptr) {
+            ++stats->zero_run_histogram[coef >> (kByteSize / 2)];
+        })
+        i += coef >> (kByteSize / 2);
+
+        if (i >= kTableSize) {
+            DLOG(ERROR) << "Wrong coef\n";
+            throw std::runtime_error("Wrong coef\n");
+        }
+        table[kZigZag[i]] = static_cast<int16_t>(value);
+        last = i;
+        ++i;
+    }
+
+    JPEG_DECODER_STATS_ONLY(if (stats != nullptr) {
+        ++stats->eob_histogram[i];
+        ++stats->blocks;
+    })
+    return last;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <glog/logging.h>
+#include "bitReader.h"
+#include "cons.h"
+#include "huffman.h"
+#include "stats.h"
+
+// Steps of Huffman decoding of the entropy-coded segment, shared by JPEGDecoder and the
+// benchmarks.
+
+// Reads |length| magnitude bits and sign-extends them to the coefficient, size 0 codes 0.
+inline int32_t ReadValue(BitReader& reader, size_t length) {
+    if (length == 0) {
+        return 0;
+    }
+
+    if (length > HuffmanTree::kMaxCodeLength) {
+        DLOG(ERROR) << "Very big int\n";
+        throw std::runtime_error("Very big int\n");
+    }
+
+    int32_t value = static_cast<int32_t>(reader.GetBits(length));
+
+    if (value < (1 << (length - 1))) {
+        return value - (1 << length) + 1;
+    }
+    return value;
+}
+
+// Reads the next symbol of |huffman| and the coefficient following it into |value|, returns
+// the symbol.
+inline uint8_t ReadCoef(BitReader& reader, const HuffmanTree& huffman, int32_t& value) {
+    HuffmanTree::Entry entry = huffman.Decode(reader.PeekBits(HuffmanTree::kMaxCodeLength));
+    if (entry.length == 0) {
+        DLOG(ERROR) << "Invalid Node\n";
+        throw std::runtime_error("Invalid Node\n");
+    }
+
+    if (entry.full_length != 0) {
+        reader.SkipBits(entry.full_length);
+        value = entry.value;
+    } else {
+        reader.SkipBits(entry.length);
+        value = ReadValue(reader, entry.symbol % (1 << (kByteSize / 2)));
+    }
+    return entry.symbol;
+}
+
+// Same as ReadCoef without computing the coefficient.
+inline uint8_t SkipCoef(BitReader& reader, const HuffmanTree& huffman) {
+    HuffmanTree::Entry entry = huffman.Decode(reader.PeekBits(HuffmanTree::kMaxCodeLength));
+    if (entry.length == 0) {
+        DLOG(ERROR) << "Invalid Node\n";
+        throw std::runtime_error("Invalid Node\n");
+    }
+
+    reader.SkipBits(entry.length);
+    reader.SkipBits(entry.symbol % (1 << (kByteSize / 2)));
+    return entry.symbol;
+}
+
+// Reads the coefficients of a baseline block into zeroed |table| in natural order, adding the
+// DC difference to |last_value|. Returns the zigzag position of the last coefficient.
+// |stats| may be nullptr.
+size_t ReadBlock(BitReader& reader, const HuffmanTree& dc, const HuffmanTree& ac,
+                 int32_t& last_value, int16_t* table, DecodeStats* stats);
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "cons.h"
+
+// Sampling factors of a channel in the frame header.
+struct Sampling {
+    uint8_t horizontal = 0;
+    uint8_t vertical = 0;
+};
+
+// Information from the markers preceding the first scan.
+struct ImageHeader {
+    // Size in the frame header, before scaling and cropping.
+    size_t width = 0;
+    size_t height = 0;
+    size_t components = 0;
+    // Sampling factors of Y, Cb and Cr, zeros for missing channels.
+    std::array<Sampling, kChannelNum> sampling{};
+    bool progressive = false;
+    std::string comment;
+    size_t restart_interval = 0;
+    // Tables with ids 0 and 1 defined before the first scan.
+    std::array<bool, 2> quant_tables{};
+    std::array<bool, 2> dc_tables{};
+    std::array<bool, 2> ac_tables{};
+};
@@ -1,103 +1,88 @@
 #include <huffman.h>
 
-#include <algorithm>
 #include <cstddef>
 #include <cstdint>
-#include <memory>
 #include <numeric>
 #include <vector>
 
 #include <glog/logging.h>
 
-class HuffmanTree::Impl {
-public:
-    Impl() = delete;
+#include "cons.h"
 
-    Impl(const std::vector<uint8_t> &code_lengths, const std::vector<uint8_t> &values) {
-        if (code_lengths.size() > 16 ||
-            std::accumulate(code_lengths.begin(), code_lengths.end(), 0u) != values.size()) {
-            DLOG(ERROR) << "Invalid Node\n";
-            throw std::invalid_argument("");
-        }
-
-        tree_.emplace_back(0, 0, 0);
-
-        size_t values_idx = 0;
-
-        std::vector<uint8_t> code_lengths_copy = code_lengths;
-
-        MakeTree(0, 0, code_lengths_copy, values, values_idx);
+HuffmanTree::HuffmanTree() {
+    max_code_.fill(-1);
+}
 
-        for (auto i : code_lengths_copy) {
-            if (i != 0) {
-                DLOG(ERROR) << "Invalid Node\n";
-                throw std::invalid_argument("");
-            }
-        }
+void HuffmanTree::Build(const std::vector<uint8_t> &code_lengths,
+                        const std::vector<uint8_t> &values) {
+    if (code_lengths.size() > kMaxCodeLength ||
+        std::accumulate(code_lengths.begin(), code_lengths.end(), 0u) != values.size()) {
+        DLOG(ERROR) << "Invalid Node\n";
+        throw std::invalid_argument("");
     }
 
-    bool Move(bool bit, int &value) {
-        index_ = bit ? tree_[index_].right_ : tree_[index_].left_;
-        if (index_ == 0) {
+    lookup_.fill(Entry());
+    max_code_.fill(-1);
+    offset_.fill(0);
+    values_ = values;
+
+    // Codes are assigned canonically: consecutive values on each level, left to right.
+    uint32_t code = 0;
+    size_t values_idx = 0;
+    for (size_t length = 1; length <= code_lengths.size(); ++length) {
+        size_t count = code_lengths[length - 1];
+        if (code + count > (1u << length)) {
             DLOG(ERROR) << "Invalid Node\n";
             throw std::invalid_argument("");
         }
-        if (tree_[index_].left_ == 0 && tree_[index_].right_ == 0) {
-            value = static_cast<int>(tree_[index_].value_);
-            index_ = 0;
-            return true;
-        }
-        return false;
-    }
-
-public:
-    struct Node {
-        size_t left_;
-        size_t right_;
-        uint8_t value_;
-
-        Node(size_t left, size_t right, uint8_t value) : left_(left), right_(right), value_(value) {
+        if (count != 0) {
+            offset_[length] = static_cast<int32_t>(values_idx) - static_cast<int32_t>(code);
+            max_code_[length] = static_cast<int32_t>(code + count - 1);
         }
-    };
-
-    std::vector<Node> tree_;
-    size_t index_ = 0;
 
-    void MakeTree(size_t idx, size_t depth, std::vector<uint8_t> &code_lengths,
-                  const std::vector<uint8_t> &values, size_t &values_idx) {
-        if (depth > 0 && code_lengths[depth - 1] > 0) {
-            --code_lengths[depth - 1];
-            tree_[idx].value_ = values[values_idx];
-            ++values_idx;
-            return;
-        }
+        for (size_t i = 0; i < count; ++i, ++code, ++values_idx) {
+            if (length > kLookupBits) {
+                continue;
+            }
 
-        if (values_idx < values.size() && depth < code_lengths.size()) {
-            tree_.emplace_back(0, 0, 0);
-            tree_[idx].left_ = tree_.size() - 1;
-            MakeTree(tree_[idx].left_, depth + 1, code_lengths, values, values_idx);
-        }
-        if (values_idx < values.size() && depth < code_lengths.size()) {
-            tree_.emplace_back(0, 0, 0);
-            tree_[idx].right_ = tree_.size() - 1;
-            MakeTree(tree_[idx].right_, depth + 1, code_lengths, values, values_idx);
+            Entry entry;
+            entry.length = length;
+            entry.symbol = values[values_idx];
+
+            size_t size = entry.symbol % (1 << (kByteSize / 2));
+            size_t shift = kLookupBits - length;
+            for (uint32_t tail = 0; tail < (1u << shift); ++tail) {
+                Entry &cell = lookup_[(code << shift) | tail];
+                cell = entry;
+                if (length + size > kLookupBits) {
+                    continue;
+                }
+                cell.full_length = length + size;
+                if (size == 0) {
+                    continue;
+                }
+                int32_t value = tail >> (shift - size);
+                if (value < (1 << (size - 1))) {
+                    value -= (1 << size) - 1;
+                }
+                cell.value = static_cast<int16_t>(value);
+            }
         }
+        code <<= 1;
     }
-};
-
-HuffmanTree::HuffmanTree() = default;
-
-void HuffmanTree::Build(const std::vector<uint8_t> &code_lengths,
-                        const std::vector<uint8_t> &values) {
-    impl_ = std::make_unique<Impl>(code_lengths, values);
 }
 
-bool HuffmanTree::Move(bool bit, int &value) {
-    if (impl_.get() == nullptr) {
-        DLOG(ERROR) << "Use uncomplete huffman tree\n";
-        throw std::invalid_argument("");
+HuffmanTree::Entry HuffmanTree::DecodeSlow(uint16_t bits) const {
+    for (size_t length = kLookupBits + 1; length <= kMaxCodeLength; ++length) {
+        int32_t code = bits >> (kMaxCodeLength - length);
+        if (code <= max_code_[length]) {
+            Entry entry;
+            entry.length = length;
+            entry.symbol = values_[code + offset_[length]];
+            return entry;
+        }
     }
-    return impl_->Move(bit, value);
+    return Entry();
 }
 
 HuffmanTree::HuffmanTree(HuffmanTree &&) = default;
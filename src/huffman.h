@@ -1,13 +1,31 @@
 #pragma once
 
+#include <array>
 #include <vector>
 #include <cstddef>
 #include <cstdint>
-#include <memory>
 
-// HuffmanTree decoder for DHT section.
+// Table-driven Huffman decoder for DHT section.
 class HuffmanTree {
 public:
+    // Number of bits resolved by a single table lookup, longer codes take the slow path.
+    static constexpr size_t kLookupBits = 9;
+
+    // Maximum length of the code in bits.
+    static constexpr size_t kMaxCodeLength = 16;
+
+    struct Entry {
+        // Number of bits of the code, 0 for invalid code.
+        uint8_t length = 0;
+        // Value of the terminated node.
+        uint8_t symbol = 0;
+        // Number of bits of the code and magnitude bits following it, if they all fit into
+        // kLookupBits, otherwise 0.
+        uint8_t full_length = 0;
+        // Sign-extended coefficient, valid only if full_length is not 0.
+        int16_t value = 0;
+    };
+
     HuffmanTree();
 
     HuffmanTree(const HuffmanTree&) = delete;
@@ -22,14 +40,25 @@ public:
     // level order.
     void Build(const std::vector<uint8_t>& code_lengths, const std::vector<uint8_t>& values);
 
-    // Moves the state of the huffman tree by |bit|. If the node is terminated,
-    // returns true and overwrites |value|. If it is intermediate, returns false
-    // and value is unmodified.
-    bool Move(bool bit, int& value);
+    // |bits| are the next kMaxCodeLength bits of the stream, first bit is the highest one.
+    // Returns the entry of the code they start with, entry.length is 0 if there is no such code.
+    Entry Decode(uint16_t bits) const {
+        const Entry& entry = lookup_[bits >> (kMaxCodeLength - kLookupBits)];
+        if (entry.length != 0) {
+            return entry;
+        }
+        return DecodeSlow(bits);
+    }
 
     ~HuffmanTree();
 
 private:
-    class Impl;
-    std::unique_ptr<Impl> impl_;
+    std::array<Entry, 1 << kLookupBits> lookup_{};
+    // Maximum code of each length, -1 if there are no codes of this length.
+    std::array<int32_t, kMaxCodeLength + 1> max_code_{};
+    // Difference between index in values_ and the code of each length.
+    std::array<int32_t, kMaxCodeLength + 1> offset_{};
+    std::vector<uint8_t> values_;
+
+    Entry DecodeSlow(uint16_t bits) const;
 };
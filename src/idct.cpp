@@ -0,0 +1,722 @@
+#include "idct.h"
+#include <glog/logging.h>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include "cons.h"
+
+#ifdef JPEG_DECODER_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+constexpr size_t kSize = kStandartMCUSize;
+
+constexpr int32_t kCenter = 128;
+
+constexpr size_t kLowSize = 4;
+
+inline uint8_t Clamp(int64_t value) {
+    return static_cast<uint8_t>(std::min<int64_t>(255, std::max<int64_t>(0, value)));
+}
+
+// Integer kernels keep intermediate values in 64 bits, as libjpeg does with JLONG: products of
+// the coefficients of corrupt streams with the constants overflow 32 bits.
+inline int64_t Descale(int64_t value, int32_t bits) {
+    return (value + (int64_t{1} << (bits - 1))) >> bits;
+}
+
+// AAN scale factors: 1 for k = 0, cos(k * pi / 16) * sqrt(2) otherwise.
+double AANScale(size_t k) {
+    return k == 0 ? 1. : std::cos(k * M_PI / 16.) * std::sqrt(2.);
+}
+
+bool IsColumnDC(const int16_t* coef) {
+    for (size_t row = 1; row < kSize; ++row) {
+        if (coef[row * kSize] != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Islow constants, scaled by 2^kIslowBits.
+constexpr int32_t kIslowBits = 13;
+constexpr int32_t kIslowPass1Bits = 2;
+constexpr int32_t kFix0298631336 = 2446;
+constexpr int32_t kFix0390180644 = 3196;
+constexpr int32_t kFix0541196100 = 4433;
+constexpr int32_t kFix0765366865 = 6270;
+constexpr int32_t kFix0899976223 = 7373;
+constexpr int32_t kFix1175875602 = 9633;
+constexpr int32_t kFix1501321110 = 12299;
+constexpr int32_t kFix1847759065 = 15137;
+constexpr int32_t kFix1961570560 = 16069;
+constexpr int32_t kFix2053119869 = 16819;
+constexpr int32_t kFix2562915447 = 20995;
+constexpr int32_t kFix3072711026 = 25172;
+
+// Input |k| of a one dimensional pass, the low frequency kernels know that inputs past
+// kLowSize are zero and skip the work on them.
+template <bool kLow, class T>
+inline T Input(const T* in, size_t k) {
+    return kLow && k >= kLowSize ? T(0) : in[k];
+}
+
+// One dimensional islow transform of 8 values, results are scaled by 2^kIslowBits.
+template <bool kLow>
+inline void IslowPass(const int64_t* in, int64_t* out) {
+    int64_t z2 = in[2];
+    int64_t z3 = Input<kLow>(in, 6);
+    int64_t z1 = (z2 + z3) * kFix0541196100;
+    int64_t tmp2 = z1 - z3 * kFix1847759065;
+    int64_t tmp3 = z1 + z2 * kFix0765366865;
+
+    z2 = in[0];
+    z3 = Input<kLow>(in, 4);
+    int64_t tmp0 = (z2 + z3) * (1 << kIslowBits);
+    int64_t tmp1 = (z2 - z3) * (1 << kIslowBits);
+
+    int64_t tmp10 = tmp0 + tmp3;
+    int64_t tmp13 = tmp0 - tmp3;
+    int64_t tmp11 = tmp1 + tmp2;
+    int64_t tmp12 = tmp1 - tmp2;
+
+    tmp0 = Input<kLow>(in, 7);
+    tmp1 = Input<kLow>(in, 5);
+    tmp2 = in[3];
+    tmp3 = in[1];
+
+    z1 = tmp0 + tmp3;
+    z2 = tmp1 + tmp2;
+    z3 = tmp0 + tmp2;
+    int64_t z4 = tmp1 + tmp3;
+    int64_t z5 = (z3 + z4) * kFix1175875602;
+
+    tmp0 *= kFix0298631336;
+    tmp1 *= kFix2053119869;
+    tmp2 *= kFix3072711026;
+    tmp3 *= kFix1501321110;
+    z1 *= -kFix0899976223;
+    z2 *= -kFix2562915447;
+    z3 = z3 * -kFix1961570560 + z5;
+    z4 = z4 * -kFix0390180644 + z5;
+
+    tmp0 += z1 + z3;
+    tmp1 += z2 + z4;
+    tmp2 += z2 + z3;
+    tmp3 += z1 + z4;
+
+    out[0] = tmp10 + tmp3;
+    out[7] = tmp10 - tmp3;
+    out[1] = tmp11 + tmp2;
+    out[6] = tmp11 - tmp2;
+    out[2] = tmp12 + tmp1;
+    out[5] = tmp12 - tmp1;
+    out[3] = tmp13 + tmp0;
+    out[4] = tmp13 - tmp0;
+}
+
+// Ifast constants, scaled by 2^kIfastBits.
+constexpr int32_t kIfastBits = 8;
+constexpr int32_t kIfastPass1Bits = 2;
+constexpr int32_t kIfastFix1082392200 = 277;
+constexpr int32_t kIfastFix1414213562 = 362;
+constexpr int32_t kIfastFix1847759065 = 473;
+constexpr int32_t kIfastFix2613125930 = 669;
+
+inline int64_t IfastMultiply(int64_t value, int64_t fix) {
+    return Descale(value * fix, kIfastBits);
+}
+
+// One dimensional AAN transform of 8 values, T is int32_t or float.
+template <bool kLow, class T, class Multiply>
+inline void AANPass(const T* in, T* out, T fix1082392200, T fix1414213562, T fix1847759065,
+                    T fix2613125930, Multiply multiply) {
+    T tmp0 = in[0];
+    T tmp1 = in[2];
+    T tmp2 = Input<kLow>(in, 4);
+    T tmp3 = Input<kLow>(in, 6);
+
+    T tmp10 = tmp0 + tmp2;
+    T tmp11 = tmp0 - tmp2;
+    T tmp13 = tmp1 + tmp3;
+    T tmp12 = multiply(tmp1 - tmp3, fix1414213562) - tmp13;
+
+    tmp0 = tmp10 + tmp13;
+    tmp3 = tmp10 - tmp13;
+    tmp1 = tmp11 + tmp12;
+    tmp2 = tmp11 - tmp12;
+
+    T tmp4 = in[1];
+    T tmp5 = in[3];
+    T tmp6 = Input<kLow>(in, 5);
+    T tmp7 = Input<kLow>(in, 7);
+
+    T z13 = tmp6 + tmp5;
+    T z10 = tmp6 - tmp5;
+    T z11 = tmp4 + tmp7;
+    T z12 = tmp4 - tmp7;
+
+    tmp7 = z11 + z13;
+    tmp11 = multiply(z11 - z13, fix1414213562);
+
+    T z5 = multiply(z10 + z12, fix1847759065);
+    tmp10 = multiply(z12, fix1082392200) - z5;
+    tmp12 = z5 - multiply(z10, fix2613125930);
+
+    tmp6 = tmp12 - tmp7;
+    tmp5 = tmp11 - tmp6;
+    tmp4 = tmp10 + tmp5;
+
+    out[0] = tmp0 + tmp7;
+    out[7] = tmp0 - tmp7;
+    out[1] = tmp1 + tmp6;
+    out[6] = tmp1 - tmp6;
+    out[2] = tmp2 + tmp5;
+    out[5] = tmp2 - tmp5;
+    out[4] = tmp3 + tmp4;
+    out[3] = tmp3 - tmp4;
+}
+
+// Scalar kernels, with kLow only the coefficients of the top-left kLowSize x kLowSize corner
+// may be nonzero.
+template <bool kLow>
+void IslowTransform(const int16_t* coef, const IDCTTable& table, uint8_t* output,
+                    size_t stride) {
+    std::array<int64_t, kTableSize> workspace;
+    std::array<int64_t, kSize> column;
+    std::array<int64_t, kSize> result;
+
+    for (size_t j = 0; j < kSize; ++j) {
+        if ((kLow && j >= kLowSize) || IsColumnDC(coef + j)) {
+            int64_t dc = kLow && j >= kLowSize
+                             ? 0
+                             : int64_t{coef[j]} * table.integer[j] * (1 << kIslowPass1Bits);
+            for (size_t i = 0; i < kSize; ++i) {
+                workspace[i * kSize + j] = dc;
+            }
+            continue;
+        }
+        for (size_t i = 0; i < (kLow ? kLowSize : kSize); ++i) {
+            column[i] = int64_t{coef[i * kSize + j]} * table.integer[i * kSize + j];
+        }
+        IslowPass<kLow>(column.data(), result.data());
+        for (size_t i = 0; i < kSize; ++i) {
+            workspace[i * kSize + j] = Descale(result[i], kIslowBits - kIslowPass1Bits);
+        }
+    }
+
+    for (size_t i = 0; i < kSize; ++i) {
+        IslowPass<kLow>(workspace.data() + i * kSize, result.data());
+        for (size_t j = 0; j < kSize; ++j) {
+            output[i * stride + j] =
+                Clamp(Descale(result[j], kIslowBits + kIslowPass1Bits + 3) + kCenter);
+        }
+    }
+}
+
+template <bool kLow>
+void IfastTransform(const int16_t* coef, const IDCTTable& table, uint8_t* output,
+                    size_t stride) {
+    std::array<int64_t, kTableSize> workspace;
+    std::array<int64_t, kSize> column;
+    std::array<int64_t, kSize> result;
+
+    for (size_t j = 0; j < kSize; ++j) {
+        if ((kLow && j >= kLowSize) || IsColumnDC(coef + j)) {
+            int64_t dc = kLow && j >= kLowSize ? 0 : int64_t{coef[j]} * table.integer[j];
+            for (size_t i = 0; i < kSize; ++i) {
+                workspace[i * kSize + j] = dc;
+            }
+            continue;
+        }
+        for (size_t i = 0; i < (kLow ? kLowSize : kSize); ++i) {
+            column[i] = int64_t{coef[i * kSize + j]} * table.integer[i * kSize + j];
+        }
+        AANPass<kLow, int64_t>(column.data(), result.data(), kIfastFix1082392200,
+                               kIfastFix1414213562, kIfastFix1847759065, kIfastFix2613125930,
+                               IfastMultiply);
+        for (size_t i = 0; i < kSize; ++i) {
+            workspace[i * kSize + j] = result[i];
+        }
+    }
+
+    for (size_t i = 0; i < kSize; ++i) {
+        AANPass<kLow, int64_t>(workspace.data() + i * kSize, result.data(),
+                               kIfastFix1082392200, kIfastFix1414213562, kIfastFix1847759065,
+                               kIfastFix2613125930, IfastMultiply);
+        for (size_t j = 0; j < kSize; ++j) {
+            output[i * stride + j] = Clamp(Descale(result[j], kIfastPass1Bits + 3) + kCenter);
+        }
+    }
+}
+
+template <bool kLow>
+void FloatTransform(const int16_t* coef, const IDCTTable& table, uint8_t* output,
+                    size_t stride) {
+    std::array<float, kTableSize> workspace;
+    std::array<float, kSize> column;
+    std::array<float, kSize> result;
+    auto multiply = [](float value, float fix) { return value * fix; };
+
+    for (size_t j = 0; j < kSize; ++j) {
+        if ((kLow && j >= kLowSize) || IsColumnDC(coef + j)) {
+            float dc = kLow && j >= kLowSize ? 0.f : coef[j] * table.real[j];
+            for (size_t i = 0; i < kSize; ++i) {
+                workspace[i * kSize + j] = dc;
+            }
+            continue;
+        }
+        for (size_t i = 0; i < (kLow ? kLowSize : kSize); ++i) {
+            column[i] = coef[i * kSize + j] * table.real[i * kSize + j];
+        }
+        AANPass<kLow, float>(column.data(), result.data(), 1.082392200f, 1.414213562f,
+                             1.847759065f, 2.613125930f, multiply);
+        for (size_t i = 0; i < kSize; ++i) {
+            workspace[i * kSize + j] = result[i];
+        }
+    }
+
+    for (size_t i = 0; i < kSize; ++i) {
+        AANPass<kLow, float>(workspace.data() + i * kSize, result.data(), 1.082392200f,
+                             1.414213562f, 1.847759065f, 2.613125930f, multiply);
+        for (size_t j = 0; j < kSize; ++j) {
+            float value = std::min(255.f, std::max(0.f, result[j] + kCenter + 0.5f));
+            output[i * stride + j] = static_cast<uint8_t>(value);
+        }
+    }
+}
+
+// Writes |value| to all samples of the block.
+inline void FillBlock(uint8_t value, uint8_t* output, size_t stride) {
+    for (size_t i = 0; i < kSize; ++i) {
+        std::memset(output + i * stride, value, kSize);
+    }
+}
+
+// Reduced transforms follow the jidctred kernels of the IJG library: an N-point pass takes the
+// same inputs as the 8-point one and folds the odd coefficients into its outputs, so the
+// samples are the averages of the full reconstruction rather than its values at a few points.
+// Results are scaled by 2^(kIslowBits + kReducedShift<N>).
+template <size_t N>
+constexpr int32_t kReducedShift = N == 4 ? 1 : N == 2 ? 2 : 0;
+
+constexpr int32_t kFix0211164243 = 1730;
+constexpr int32_t kFix0509795579 = 4176;
+constexpr int32_t kFix0601344887 = 4926;
+constexpr int32_t kFix0720959822 = 5906;
+constexpr int32_t kFix0850430095 = 6967;
+constexpr int32_t kFix1061594337 = 8697;
+constexpr int32_t kFix1272758580 = 10426;
+constexpr int32_t kFix1451774981 = 11893;
+constexpr int32_t kFix2172734803 = 17799;
+constexpr int32_t kFix3624509785 = 29692;
+
+template <size_t N>
+inline void ReducedPass(const int64_t* in, int64_t* out) {
+    if (N == 8) {
+        IslowPass<false>(in, out);
+    } else if (N == 4) {
+        int64_t tmp0 = in[0] * (1 << (kIslowBits + 1));
+        int64_t tmp2 = in[2] * kFix1847759065 - in[6] * kFix0765366865;
+        int64_t tmp10 = tmp0 + tmp2;
+        int64_t tmp12 = tmp0 - tmp2;
+
+        tmp0 = -in[7] * kFix0211164243 + in[5] * kFix1451774981 - in[3] * kFix2172734803 +
+               in[1] * kFix1061594337;
+        tmp2 = -in[7] * kFix0509795579 - in[5] * kFix0601344887 + in[3] * kFix0899976223 +
+               in[1] * kFix2562915447;
+
+        out[0] = tmp10 + tmp2;
+        out[3] = tmp10 - tmp2;
+        out[1] = tmp12 + tmp0;
+        out[2] = tmp12 - tmp0;
+    } else if (N == 2) {
+        int64_t tmp10 = in[0] * (1 << (kIslowBits + 2));
+        int64_t tmp0 = -in[7] * kFix0720959822 + in[5] * kFix0850430095 -
+                       in[3] * kFix1272758580 + in[1] * kFix3624509785;
+
+        out[0] = tmp10 + tmp0;
+        out[1] = tmp10 - tmp0;
+    } else {
+        out[0] = in[0] * (1 << kIslowBits);
+    }
+}
+
+// Inputs |k| the N-point pass uses.
+template <size_t N>
+constexpr bool IsReducedInput(size_t k) {
+    return N == 8 || k == 0 || (N == 4 && k != 4) || (N == 2 && k % 2 == 1);
+}
+
+// Reconstructs kWidth x kHeight samples, the columns of the block are reduced to kHeight
+// values first and the rows to kWidth values after that. Columns the second pass does not use
+// are skipped.
+template <size_t kWidth, size_t kHeight>
+void IDCTReduced(const int16_t* coef, const IDCTTable& table, uint8_t* output, size_t stride) {
+    std::array<int64_t, kHeight * kSize> workspace{};
+    std::array<int64_t, kSize> column;
+    std::array<int64_t, kSize> result;
+
+    for (size_t j = 0; j < kSize; ++j) {
+        if (!IsReducedInput<kWidth>(j)) {
+            continue;
+        }
+        for (size_t i = 0; i < kSize; ++i) {
+            column[i] = int64_t{coef[i * kSize + j]} * table.integer[i * kSize + j];
+        }
+        ReducedPass<kHeight>(column.data(), result.data());
+        for (size_t i = 0; i < kHeight; ++i) {
+            workspace[i * kSize + j] =
+                Descale(result[i], kIslowBits - kIslowPass1Bits + kReducedShift<kHeight>);
+        }
+    }
+
+    for (size_t i = 0; i < kHeight; ++i) {
+        ReducedPass<kWidth>(workspace.data() + i * kSize, result.data());
+        for (size_t j = 0; j < kWidth; ++j) {
+            output[i * stride + j] = Clamp(
+                Descale(result[j], kIslowBits + kIslowPass1Bits + 3 + kReducedShift<kWidth>) +
+                kCenter);
+        }
+    }
+}
+
+// Reduced kernels by log2 of the height and of the width.
+const IDCTFunction kReducedIDCT[4][4] = {
+    {IDCTReduced<1, 1>, IDCTReduced<2, 1>, IDCTReduced<4, 1>, IDCTReduced<8, 1>},
+    {IDCTReduced<1, 2>, IDCTReduced<2, 2>, IDCTReduced<4, 2>, IDCTReduced<8, 2>},
+    {IDCTReduced<1, 4>, IDCTReduced<2, 4>, IDCTReduced<4, 4>, IDCTReduced<8, 4>},
+    {IDCTReduced<1, 8>, IDCTReduced<2, 8>, IDCTReduced<4, 8>, IDCTReduced<8, 8>},
+};
+
+size_t ReducedIndex(size_t size) {
+    if (size == 1) {
+        return 0;
+    } else if (size == 2) {
+        return 1;
+    } else if (size == 4) {
+        return 2;
+    } else if (size == 8) {
+        return 3;
+    }
+    DLOG(ERROR) << "Wrong reduced IDCT size\n";
+    throw std::invalid_argument("Wrong reduced IDCT size\n");
+}
+
+#ifdef JPEG_DECODER_SSE2
+
+bool HasSSE2() {
+    return __builtin_cpu_supports("sse2");
+}
+
+// 32-bit lanes of eight 16-bit values.
+struct Wide {
+    __m128i lo;
+    __m128i hi;
+};
+
+__attribute__((target("sse2"))) inline Wide Add(Wide lhs, Wide rhs) {
+    return {_mm_add_epi32(lhs.lo, rhs.lo), _mm_add_epi32(lhs.hi, rhs.hi)};
+}
+
+__attribute__((target("sse2"))) inline Wide Sub(Wide lhs, Wide rhs) {
+    return {_mm_sub_epi32(lhs.lo, rhs.lo), _mm_sub_epi32(lhs.hi, rhs.hi)};
+}
+
+// Returns lhs * first + rhs * second, lane-wise in 32 bits.
+__attribute__((target("sse2"))) inline Wide MulAdd(__m128i lhs, __m128i rhs, int32_t first,
+                                                   int32_t second) {
+    __m128i factors = _mm_set_epi16(second, first, second, first, second, first, second, first);
+    return {_mm_madd_epi16(_mm_unpacklo_epi16(lhs, rhs), factors),
+            _mm_madd_epi16(_mm_unpackhi_epi16(lhs, rhs), factors)};
+}
+
+// Descales by |bits| with rounding, adds |center| and packs back to 16 bits with saturation.
+template <int32_t bits>
+__attribute__((target("sse2"))) inline __m128i DescalePack(Wide value, int32_t center) {
+    __m128i bias = _mm_set1_epi32((1 << (bits - 1)) + center * (1 << bits));
+    return _mm_packs_epi32(_mm_srai_epi32(_mm_add_epi32(value.lo, bias), bits),
+                           _mm_srai_epi32(_mm_add_epi32(value.hi, bias), bits));
+}
+
+// IslowPass applied to each of the eight lanes, in[i] holds i-th input of every lane. Scalar
+// products are regrouped into pairs, so every multiplication is a single madd. With kLow
+// inputs past kLowSize are zero.
+template <bool kLow>
+__attribute__((target("sse2"))) inline void IslowPassSSE2(const __m128i* in, Wide* out) {
+    __m128i zero = _mm_setzero_si128();
+    __m128i in4 = kLow ? zero : in[4];
+    __m128i in5 = kLow ? zero : in[5];
+    __m128i in6 = kLow ? zero : in[6];
+    __m128i in7 = kLow ? zero : in[7];
+
+    Wide tmp0;
+    Wide tmp1;
+    if (kLow) {
+        // Sign extension of in[0] shifted by kIslowBits.
+        tmp0 = {_mm_srai_epi32(_mm_unpacklo_epi16(zero, in[0]), 16 - kIslowBits),
+                _mm_srai_epi32(_mm_unpackhi_epi16(zero, in[0]), 16 - kIslowBits)};
+        tmp1 = tmp0;
+    } else {
+        tmp0 = MulAdd(in[0], in4, 1 << kIslowBits, 1 << kIslowBits);
+        tmp1 = MulAdd(in[0], in4, 1 << kIslowBits, -(1 << kIslowBits));
+    }
+    Wide tmp2 = MulAdd(in[2], in6, kFix0541196100, kFix0541196100 - kFix1847759065);
+    Wide tmp3 = MulAdd(in[2], in6, kFix0541196100 + kFix0765366865, kFix0541196100);
+
+    Wide tmp10 = Add(tmp0, tmp3);
+    Wide tmp13 = Sub(tmp0, tmp3);
+    Wide tmp11 = Add(tmp1, tmp2);
+    Wide tmp12 = Sub(tmp1, tmp2);
+
+    __m128i z3 = _mm_add_epi16(in7, in[3]);
+    __m128i z4 = _mm_add_epi16(in5, in[1]);
+    Wide z3w = MulAdd(z3, z4, kFix1175875602 - kFix1961570560, kFix1175875602);
+    Wide z4w = MulAdd(z3, z4, kFix1175875602, kFix1175875602 - kFix0390180644);
+
+    tmp0 = Add(MulAdd(in7, in[1], kFix0298631336 - kFix0899976223, -kFix0899976223), z3w);
+    tmp3 = Add(MulAdd(in7, in[1], -kFix0899976223, kFix1501321110 - kFix0899976223), z4w);
+    tmp1 = Add(MulAdd(in5, in[3], kFix2053119869 - kFix2562915447, -kFix2562915447), z4w);
+    tmp2 = Add(MulAdd(in5, in[3], -kFix2562915447, kFix3072711026 - kFix2562915447), z3w);
+
+    out[0] = Add(tmp10, tmp3);
+    out[7] = Sub(tmp10, tmp3);
+    out[1] = Add(tmp11, tmp2);
+    out[6] = Sub(tmp11, tmp2);
+    out[2] = Add(tmp12, tmp1);
+    out[5] = Sub(tmp12, tmp1);
+    out[3] = Add(tmp13, tmp0);
+    out[4] = Sub(tmp13, tmp0);
+}
+
+__attribute__((target("sse2"))) inline void Transpose(__m128i* rows) {
+    __m128i a0 = _mm_unpacklo_epi16(rows[0], rows[1]);
+    __m128i a1 = _mm_unpackhi_epi16(rows[0], rows[1]);
+    __m128i a2 = _mm_unpacklo_epi16(rows[2], rows[3]);
+    __m128i a3 = _mm_unpackhi_epi16(rows[2], rows[3]);
+    __m128i a4 = _mm_unpacklo_epi16(rows[4], rows[5]);
+    __m128i a5 = _mm_unpackhi_epi16(rows[4], rows[5]);
+    __m128i a6 = _mm_unpacklo_epi16(rows[6], rows[7]);
+    __m128i a7 = _mm_unpackhi_epi16(rows[6], rows[7]);
+
+    __m128i b0 = _mm_unpacklo_epi32(a0, a2);
+    __m128i b1 = _mm_unpackhi_epi32(a0, a2);
+    __m128i b2 = _mm_unpacklo_epi32(a1, a3);
+    __m128i b3 = _mm_unpackhi_epi32(a1, a3);
+    __m128i b4 = _mm_unpacklo_epi32(a4, a6);
+    __m128i b5 = _mm_unpackhi_epi32(a4, a6);
+    __m128i b6 = _mm_unpacklo_epi32(a5, a7);
+    __m128i b7 = _mm_unpackhi_epi32(a5, a7);
+
+    rows[0] = _mm_unpacklo_epi64(b0, b4);
+    rows[1] = _mm_unpackhi_epi64(b0, b4);
+    rows[2] = _mm_unpacklo_epi64(b1, b5);
+    rows[3] = _mm_unpackhi_epi64(b1, b5);
+    rows[4] = _mm_unpacklo_epi64(b2, b6);
+    rows[5] = _mm_unpackhi_epi64(b2, b6);
+    rows[6] = _mm_unpacklo_epi64(b3, b7);
+    rows[7] = _mm_unpackhi_epi64(b3, b7);
+}
+
+// With kLow rows and columns past kLowSize are zero before and after the first pass.
+template <bool kLow>
+__attribute__((target("sse2"))) inline void IslowTransformSSE2(const int16_t* coef,
+                                                               const IDCTTable& table,
+                                                               uint8_t* output, size_t stride) {
+    if (!table.fits_integer16) {
+        IslowTransform<kLow>(coef, table, output, stride);
+        return;
+    }
+
+    __m128i rows[kSize];
+    Wide result[kSize];
+
+    // A product fits into 16 bits if its high half is the sign extension of the low one.
+    __m128i overflow = _mm_setzero_si128();
+    for (size_t i = 0; i < kSize; ++i) {
+        if (kLow && i >= kLowSize) {
+            rows[i] = _mm_setzero_si128();
+            continue;
+        }
+        __m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(coef + i * kSize));
+        __m128i factors =
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(table.integer16.data() + i * kSize));
+        rows[i] = _mm_mullo_epi16(values, factors);
+        overflow = _mm_or_si128(overflow, _mm_xor_si128(_mm_mulhi_epi16(values, factors),
+                                                        _mm_srai_epi16(rows[i], 15)));
+    }
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(overflow, _mm_setzero_si128())) != 0xFFFF) {
+        IslowTransform<kLow>(coef, table, output, stride);
+        return;
+    }
+
+    IslowPassSSE2<kLow>(rows, result);
+    for (size_t i = 0; i < kSize; ++i) {
+        rows[i] = DescalePack<kIslowBits - kIslowPass1Bits>(result[i], 0);
+    }
+    Transpose(rows);
+
+    IslowPassSSE2<kLow>(rows, result);
+    for (size_t i = 0; i < kSize; ++i) {
+        rows[i] = DescalePack<kIslowBits + kIslowPass1Bits + 3>(result[i], kCenter);
+    }
+    Transpose(rows);
+
+    for (size_t i = 0; i < kSize; ++i) {
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(output + i * stride),
+                         _mm_packus_epi16(rows[i], rows[i]));
+    }
+}
+
+#endif
+
+}  // namespace
+
+void PrepareIDCTTable(IDCTMethod method, const std::vector<int32_t>& dqt, IDCTTable& table) {
+    if (dqt.size() != kTableSize) {
+        DLOG(ERROR) << "Wrong DQT size\n";
+        throw std::runtime_error("Wrong DQT size\n");
+    }
+
+    constexpr int32_t kMaxInteger16 = std::numeric_limits<int16_t>::max();
+    table.fits_integer16 = true;
+    for (size_t row = 0; row < kSize; ++row) {
+        for (size_t column = 0; column < kSize; ++column) {
+            size_t i = row * kSize + column;
+            double scale = AANScale(row) * AANScale(column);
+            if (method == IDCTMethod::kIslow) {
+                table.integer[i] = dqt[i];
+                table.fits_integer16 = table.fits_integer16 && dqt[i] <= kMaxInteger16;
+                table.integer16[i] = static_cast<int16_t>(std::min(dqt[i], kMaxInteger16));
+            } else if (method == IDCTMethod::kIfast) {
+                table.integer[i] =
+                    static_cast<int32_t>(std::lround(dqt[i] * scale * (1 << kIfastPass1Bits)));
+            } else {
+                // Division by 8 of the two dimensional transform is folded into the table.
+                table.real[i] = static_cast<float>(dqt[i] * scale / kSize);
+            }
+        }
+    }
+}
+
+IDCTFunction GetIDCT(IDCTMethod method) {
+    if (method == IDCTMethod::kIfast) {
+        return IDCTIfast;
+    } else if (method == IDCTMethod::kFloat) {
+        return IDCTFloat;
+    }
+#ifdef JPEG_DECODER_SSE2
+    if (HasSSE2()) {
+        return IDCTIslowSSE2;
+    }
+#endif
+    return IDCTIslow;
+}
+
+IDCTFunction GetDCIDCT(IDCTMethod method) {
+    if (method == IDCTMethod::kIfast) {
+        return IDCTIfastDC;
+    } else if (method == IDCTMethod::kFloat) {
+        return IDCTFloatDC;
+    }
+    return IDCTIslowDC;
+}
+
+IDCTFunction GetLowIDCT(IDCTMethod method) {
+    if (method == IDCTMethod::kIfast) {
+        return IDCTIfastLow;
+    } else if (method == IDCTMethod::kFloat) {
+        return IDCTFloatLow;
+    }
+#ifdef JPEG_DECODER_SSE2
+    if (HasSSE2()) {
+        return IDCTIslowLowSSE2;
+    }
+#endif
+    return IDCTIslowLow;
+}
+
+IDCTFunction GetReducedIDCT(size_t width, size_t height) {
+    if (width == kSize && height == kSize) {
+        return GetIDCT(IDCTMethod::kIslow);
+    }
+    return kReducedIDCT[ReducedIndex(height)][ReducedIndex(width)];
+}
+
+void IDCTReduced4x4(const int16_t* coef, const IDCTTable& table, uint8_t* output,
+                    size_t stride) {
+    IDCTReduced<4, 4>(coef, table, output, stride);
+}
+
+void IDCTReduced2x2(const int16_t* coef, const IDCTTable& table, uint8_t* output,
+                    size_t stride) {
+    IDCTReduced<2, 2>(coef, table, output, stride);
+}
+
+void IDCTReduced1x1(const int16_t* coef, const IDCTTable& table, uint8_t* output,
+                    size_t stride) {
+    IDCTReduced<1, 1>(coef, table, output, stride);
+}
+
+#ifdef JPEG_DECODER_SSE2
+
+__attribute__((target("sse2"))) void IDCTIslowSSE2(const int16_t* coef, const IDCTTable& table,
+                                                   uint8_t* output, size_t stride) {
+    IslowTransformSSE2<false>(coef, table, output, stride);
+}
+
+__attribute__((target("sse2"))) void IDCTIslowLowSSE2(const int16_t* coef,
+                                                      const IDCTTable& table, uint8_t* output,
+                                                      size_t stride) {
+    IslowTransformSSE2<true>(coef, table, output, stride);
+}
+
+#endif
+
+
+void IDCTIslow(const int16_t* coef, const IDCTTable& table, uint8_t* output, size_t stride) {
+    IslowTransform<false>(coef, table, output, stride);
+}
+
+void IDCTIfast(const int16_t* coef, const IDCTTable& table, uint8_t* output, size_t stride) {
+    IfastTransform<false>(coef, table, output, stride);
+}
+
+void IDCTFloat(const int16_t* coef, const IDCTTable& table, uint8_t* output, size_t stride) {
+    FloatTransform<false>(coef, table, output, stride);
+}
+
+void IDCTIslowLow(const int16_t* coef, const IDCTTable& table, uint8_t* output, size_t stride) {
+    IslowTransform<true>(coef, table, output, stride);
+}
+
+void IDCTIfastLow(const int16_t* coef, const IDCTTable& table, uint8_t* output, size_t stride) {
+    IfastTransform<true>(coef, table, output, stride);
+}
+
+void IDCTFloatLow(const int16_t* coef, const IDCTTable& table, uint8_t* output, size_t stride) {
+    FloatTransform<true>(coef, table, output, stride);
+}
+
+// Columns and then rows of a DC-only block are constant, so each kernel reduces to the
+// descaling of its DC path.
+void IDCTIslowDC(const int16_t* coef, const IDCTTable& table, uint8_t* output, size_t stride) {
+    FillBlock(Clamp(Descale(int64_t{coef[0]} * table.integer[0], 3) + kCenter), output, stride);
+}
+
+void IDCTIfastDC(const int16_t* coef, const IDCTTable& table, uint8_t* output, size_t stride) {
+    FillBlock(Clamp(Descale(int64_t{coef[0]} * table.integer[0], kIfastPass1Bits + 3) + kCenter),
+              output, stride);
+}
+
+void IDCTFloatDC(const int16_t* coef, const IDCTTable& table, uint8_t* output, size_t stride) {
+    float value = std::min(255.f, std::max(0.f, coef[0] * table.real[0] + kCenter + 0.5f));
+    FillBlock(static_cast<uint8_t>(value), output, stride);
+}
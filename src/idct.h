@@ -0,0 +1,87 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "cons.h"
+
+enum class IDCTMethod {
+    // Accurate integer transform (Loeffler-Ligtenberg-Moschytz with 13 bits constants).
+    kIslow,
+    // Faster and less accurate integer transform (Arai-Agui-Nakajima with 8 bits constants).
+    kIfast,
+    // Floating point Arai-Agui-Nakajima transform.
+    kFloat,
+};
+
+// Quantization table premultiplied by the scale factors of the IDCT method, so
+// dequantization is a single multiplication inside the transform.
+struct IDCTTable {
+    std::array<int32_t, kTableSize> integer{};
+    // Copy of |integer| for the SIMD kernels, which keep the block in 16-bit lanes.
+    std::array<int16_t, kTableSize> integer16{};
+    // False if some value of |integer| does not fit into |integer16|, as in 16-bit DQT.
+    bool fits_integer16 = true;
+    std::array<float, kTableSize> real{};
+};
+
+// Dequantizes 8x8 block of coefficients in natural order, applies inverse DCT, level shift
+// and clamp, writes samples row by row to |output| with |stride| bytes between rows.
+using IDCTFunction = void (*)(const int16_t* coef, const IDCTTable& table, uint8_t* output,
+                              size_t stride);
+
+// Fills |table| from quantization table |dqt| in natural order.
+void PrepareIDCTTable(IDCTMethod method, const std::vector<int32_t>& dqt, IDCTTable& table);
+
+// Blocks whose nonzero coefficients are all among the first kLowFrequencyCount in zigzag
+// order have them in the top-left 4x4 corner.
+constexpr size_t kLowFrequencyCount = 10;
+
+// Returns the fastest kernel of |method| supported by the CPU.
+IDCTFunction GetIDCT(IDCTMethod method);
+
+// Returns the kernel of |method| for blocks with only the DC coefficient, which fills the
+// block with one value. Results are the same as of GetIDCT.
+IDCTFunction GetDCIDCT(IDCTMethod method);
+
+// Returns the kernel of |method| for blocks whose nonzero coefficients lie in the top-left 4x4
+// corner, it skips the rest. Results are the same as of GetIDCT.
+IDCTFunction GetLowIDCT(IDCTMethod method);
+
+// Returns transform reconstructing |width| x |height| samples (each 1, 2, 4 or 8) of the block,
+// used for decoding at a reduced scale. Expects kIslow table.
+IDCTFunction GetReducedIDCT(size_t width, size_t height);
+
+void IDCTIslow(const int16_t* coef, const IDCTTable& table, uint8_t* output, size_t stride);
+
+void IDCTIfast(const int16_t* coef, const IDCTTable& table, uint8_t* output, size_t stride);
+
+void IDCTFloat(const int16_t* coef, const IDCTTable& table, uint8_t* output, size_t stride);
+
+void IDCTIslowLow(const int16_t* coef, const IDCTTable& table, uint8_t* output, size_t stride);
+
+void IDCTIfastLow(const int16_t* coef, const IDCTTable& table, uint8_t* output, size_t stride);
+
+void IDCTFloatLow(const int16_t* coef, const IDCTTable& table, uint8_t* output, size_t stride);
+
+void IDCTIslowDC(const int16_t* coef, const IDCTTable& table, uint8_t* output, size_t stride);
+
+void IDCTIfastDC(const int16_t* coef, const IDCTTable& table, uint8_t* output, size_t stride);
+
+void IDCTFloatDC(const int16_t* coef, const IDCTTable& table, uint8_t* output, size_t stride);
+
+void IDCTReduced4x4(const int16_t* coef, const IDCTTable& table, uint8_t* output, size_t stride);
+
+void IDCTReduced2x2(const int16_t* coef, const IDCTTable& table, uint8_t* output, size_t stride);
+
+void IDCTReduced1x1(const int16_t* coef, const IDCTTable& table, uint8_t* output, size_t stride);
+
+#ifdef JPEG_DECODER_SSE2
+// Same as IDCTIslow for blocks of valid 8-bit streams. Tables and blocks whose dequantized
+// coefficients do not fit into 16 bits are passed to IDCTIslow.
+void IDCTIslowSSE2(const int16_t* coef, const IDCTTable& table, uint8_t* output, size_t stride);
+
+void IDCTIslowLowSSE2(const int16_t* coef, const IDCTTable& table, uint8_t* output,
+                      size_t stride);
+#endif
@@ -2,45 +2,205 @@
 
 #include <vector>
 #include <cstddef>
+#include <cstdint>
+#include <functional>
 #include <string>
+#include <utility>
 
 struct RGB {
     int r, g, b;
 };
 
+enum class PixelFormat {
+    kGray8,
+    kRGB8,
+    kRGBA8,
+};
+
+inline size_t BytesPerPixel(PixelFormat format) {
+    if (format == PixelFormat::kGray8) {
+        return 1;
+    } else if (format == PixelFormat::kRGB8) {
+        return 3;
+    }
+    return 4;
+}
+
+// Non-owning view of contiguous elements.
+template <class T>
+class Span {
+public:
+    Span(T* data, size_t size) : data_(data), size_(size) {
+    }
+
+    T* begin() const {
+        return data_;
+    }
+
+    T* end() const {
+        return data_ + size_;
+    }
+
+    T* data() const {
+        return data_;
+    }
+
+    size_t size() const {
+        return size_;
+    }
+
+    T& operator[](size_t i) const {
+        return data_[i];
+    }
+
+private:
+    T* data_;
+    size_t size_;
+};
+
+// Pixels are stored in one buffer row by row, Stride() bytes between rows, channels of
+// a pixel are consecutive bytes in the order of the PixelFormat name.
 class Image {
 public:
     Image() {
     }
-    Image(size_t width, size_t height) {
-        SetSize(width, height);
+    Image(size_t width, size_t height, PixelFormat format = PixelFormat::kRGB8) {
+        SetSize(width, height, format);
     }
 
-    void SetSize(size_t width, size_t height) {
-        data_.assign(height, std::vector<RGB>(width));
+    void SetSize(size_t width, size_t height, PixelFormat format = PixelFormat::kRGB8) {
+        width_ = width;
+        height_ = height;
+        format_ = format;
+        stride_ = width * BytesPerPixel(format);
+        data_.assign(stride_ * height, 0);
+        if (format == PixelFormat::kRGBA8) {
+            for (size_t i = 3; i < data_.size(); i += 4) {
+                data_[i] = 255;
+            }
+        }
     }
 
     size_t Width() const {
-        if (data_.empty()) {
-            return 0;
-        }
-        return data_[0].size();
+        return width_;
     }
 
     size_t Height() const {
-        return data_.size();
+        return height_;
+    }
+
+    PixelFormat Format() const {
+        return format_;
+    }
+
+    size_t Stride() const {
+        return stride_;
+    }
+
+    uint8_t* Data() {
+        return data_.data();
+    }
+
+    const uint8_t* Data() const {
+        return data_.data();
+    }
+
+    uint8_t* Row(size_t y) {
+        return data_.data() + y * stride_;
+    }
+
+    const uint8_t* Row(size_t y) const {
+        return data_.data() + y * stride_;
+    }
+
+    Span<uint8_t> RowSpan(size_t y) {
+        return {Row(y), width_ * BytesPerPixel(format_)};
+    }
+
+    Span<const uint8_t> RowSpan(size_t y) const {
+        return {Row(y), width_ * BytesPerPixel(format_)};
     }
 
     void SetPixel(int y, int x, const RGB& pixel) {
-        data_[y][x] = pixel;
+        uint8_t* data = Row(y) + x * BytesPerPixel(format_);
+        if (format_ == PixelFormat::kGray8) {
+            data[0] = static_cast<uint8_t>((pixel.r * 77 + pixel.g * 150 + pixel.b * 29) >> 8);
+            return;
+        }
+        data[0] = static_cast<uint8_t>(pixel.r);
+        data[1] = static_cast<uint8_t>(pixel.g);
+        data[2] = static_cast<uint8_t>(pixel.b);
     }
 
     RGB GetPixel(int y, int x) const {
-        return data_[y][x];
+        const uint8_t* data = Row(y) + x * BytesPerPixel(format_);
+        if (format_ == PixelFormat::kGray8) {
+            return {data[0], data[0], data[0]};
+        }
+        return {data[0], data[1], data[2]};
+    }
+
+    void SetComment(const std::string& comment) {
+        comment_ = comment;
+    }
+
+    const std::string& GetComment() const {
+        return comment_;
+    }
+
+private:
+    std::vector<uint8_t> data_;
+    size_t width_ = 0;
+    size_t height_ = 0;
+    size_t stride_ = 0;
+    PixelFormat format_ = PixelFormat::kRGB8;
+    std::string comment_;
+};
+
+// Components of an image at their own resolution, without upsampling or color conversion:
+// 4:2:0 files give I420 planes, 4:2:2 give I422 and 4:4:4 give I444. Grayscale images have
+// only the Y plane. Rows of a plane are Stride(plane) bytes apart.
+class PlanarImage {
+public:
+    // Appends a plane of |width| x |height| samples.
+    void AddPlane(size_t width, size_t height) {
+        Plane plane;
+        plane.width = width;
+        plane.height = height;
+        plane.data.assign(width * height, 0);
+        planes_.push_back(std::move(plane));
+    }
+
+    size_t Planes() const {
+        return planes_.size();
     }
 
-    RGB& GetPixel(int y, int x) {
-        return data_[y][x];
+    size_t Width(size_t plane) const {
+        return planes_[plane].width;
+    }
+
+    size_t Height(size_t plane) const {
+        return planes_[plane].height;
+    }
+
+    size_t Stride(size_t plane) const {
+        return planes_[plane].width;
+    }
+
+    uint8_t* Data(size_t plane) {
+        return planes_[plane].data.data();
+    }
+
+    const uint8_t* Data(size_t plane) const {
+        return planes_[plane].data.data();
+    }
+
+    uint8_t* Row(size_t plane, size_t y) {
+        return Data(plane) + y * Stride(plane);
+    }
+
+    const uint8_t* Row(size_t plane, size_t y) const {
+        return Data(plane) + y * Stride(plane);
     }
 
     void SetComment(const std::string& comment) {
@@ -52,6 +212,32 @@ public:
     }
 
 private:
-    std::vector<std::vector<RGB>> data_;
+    struct Plane {
+        std::vector<uint8_t> data;
+        size_t width = 0;
+        size_t height = 0;
+    };
+
+    std::vector<Plane> planes_;
     std::string comment_;
 };
+
+// Consecutive rows of the decoded image, laid out as in Image.
+struct RowBand {
+    // Index of the first row in the image and number of rows.
+    size_t row = 0;
+    size_t count = 0;
+    // Size of the whole decoded image.
+    size_t width = 0;
+    size_t height = 0;
+    PixelFormat format = PixelFormat::kRGB8;
+    const uint8_t* data = nullptr;
+    size_t stride = 0;
+
+    Span<const uint8_t> RowSpan(size_t i) const {
+        return {data + i * stride, width * BytesPerPixel(format)};
+    }
+};
+
+// Receives the rows of the image top to bottom, the band is valid only during the call.
+using RowCallback = std::function<void(const RowBand& band)>;
@@ -0,0 +1,68 @@
+#include "mappedFile.h"
+#include <glog/logging.h>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define JPEG_DECODER_MMAP
+#endif
+
+MappedFile::MappedFile(const std::string& path) : data_(nullptr), size_(0) {
+#ifdef JPEG_DECODER_MMAP
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        DLOG(ERROR) << "Can't open file " << path << "\n";
+        throw std::runtime_error("Can't open file\n");
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        close(fd);
+        DLOG(ERROR) << "Can't stat file " << path << "\n";
+        throw std::runtime_error("Can't open file\n");
+    }
+    size_ = static_cast<size_t>(info.st_size);
+
+    if (size_ != 0) {
+        void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            close(fd);
+            DLOG(ERROR) << "Can't map file " << path << "\n";
+            throw std::runtime_error("Can't open file\n");
+        }
+        madvise(data, size_, MADV_SEQUENTIAL);
+        data_ = static_cast<const uint8_t*>(data);
+    }
+    close(fd);
+#else
+    std::ifstream input(path, std::ios::binary);
+    if (!input) {
+        DLOG(ERROR) << "Can't open file " << path << "\n";
+        throw std::runtime_error("Can't open file\n");
+    }
+    buffer_.assign(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>());
+    data_ = buffer_.data();
+    size_ = buffer_.size();
+#endif
+}
+
+const uint8_t* MappedFile::Data() const {
+    return data_;
+}
+
+size_t MappedFile::Size() const {
+    return size_;
+}
+
+MappedFile::~MappedFile() {
+#ifdef JPEG_DECODER_MMAP
+    if (data_ != nullptr) {
+        munmap(const_cast<uint8_t*>(data_), size_);
+    }
+#endif
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Read-only view of the whole file, memory-mapped where the platform allows it.
+class MappedFile {
+public:
+    MappedFile() = delete;
+
+    explicit MappedFile(const std::string& path);
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const uint8_t* Data() const;
+
+    size_t Size() const;
+
+    ~MappedFile();
+
+private:
+    const uint8_t* data_;
+    size_t size_;
+    // Contents of the file if it is not mapped.
+    std::vector<uint8_t> buffer_;
+};
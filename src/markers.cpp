@@ -1,9 +1,10 @@
 #include "markers.h"
 #include <glog/logging.h>
+#include <array>
 #include <cstddef>
 #include <cstdint>
-#include <functional>
 #include <limits>
+#include <numeric>
 #include <stdexcept>
 #include "JPEGDecoder.h"
 #include "cons.h"
@@ -32,6 +33,9 @@ void ProcessMarker(MarkerType marker, JPEGDecoder& decoder) {
     } else if (marker == kMarkerSOF0) {
         DLOG(INFO) << "Read meta inforamtion\n";
         ProcessSOF0(decoder);
+    } else if (marker == kMarkerSOF2) {
+        DLOG(INFO) << "Read progressive meta inforamtion\n";
+        ProcessSOF2(decoder);
     } else if (marker == kMarkerDHT) {
         DLOG(INFO) << "Read DHT\n";
         ProcessDHT(decoder);
@@ -47,6 +51,9 @@ void ProcessMarker(MarkerType marker, JPEGDecoder& decoder) {
     } else if (marker == kMarkerSOS) {
         DLOG(INFO) << "Start main part\n";
         ProcessSOS(decoder);
+    } else if (marker == kMarkerDRI) {
+        DLOG(INFO) << "Read restart interval\n";
+        ProcessDRI(decoder);
     } else {
         DLOG(ERROR) << "Unknown marker\n";
         throw std::runtime_error("Unknown marker\n");
@@ -107,47 +114,50 @@ void ProcessSOF0(JPEGDecoder& decoder) {
         DLOG(ERROR) << "Wrong channels num\n";
         throw std::runtime_error("Wrong channels num\n");
     }
+    decoder.GetHeader().components = channel_num;
 
     uint8_t horizontal_max = std::numeric_limits<uint8_t>::min();
     uint8_t vertical_max = std::numeric_limits<uint8_t>::min();
 
     for (size_t i = 0; i < channel_num; ++i) {
-        Channel channel;
-
         uint8_t id = decoder.ReadByte();
         uint8_t pr = decoder.ReadByte();
 
+        if (id == 0 || id > kChannelNum) {
+            DLOG(ERROR) << "Incorrect quant id: " << id << " channel num: " << i << "\n";
+            throw std::runtime_error("Incorrect quant id\n");
+        }
+
+        // Channels are filled in place to keep their buffers from the previous images.
+        Channel& channel = decoder.GetChannelById(id - 1);
         channel.horizontal = (pr >> (kByteSize / 2));
         channel.vertical = (pr % (1 << (kByteSize / 2)));
+        channel.used_ = true;
+        decoder.GetHeader().sampling[id - 1] = {channel.horizontal, channel.vertical};
 
         horizontal_max = std::max(horizontal_max, channel.horizontal);
         vertical_max = std::max(vertical_max, channel.vertical);
 
         channel.DQTid = decoder.ReadByte();
-
-        if (id == 1) {
-            decoder.Y = std::move(channel);
-            decoder.Y.used_ = true;
-        } else if (id == 2) {
-            decoder.Cb = std::move(channel);
-            decoder.Cb.used_ = true;
-        } else if (id == 3) {
-            decoder.Cr = std::move(channel);
-            decoder.Cr.used_ = true;
-        } else {
-            DLOG(ERROR) << "Incorrect quant id: " << id << " channel num: " << i << "\n";
-            throw std::runtime_error("Incorrect quant id\n");
-        }
     }
 
     SetChannelScale(decoder.Y, horizontal_max, vertical_max);
     SetChannelScale(decoder.Cb, horizontal_max, vertical_max);
     SetChannelScale(decoder.Cr, horizontal_max, vertical_max);
+    decoder.PrepareBlocks();
+}
+
+void ProcessSOF2(JPEGDecoder& decoder) {
+    decoder.SetProgressive();
+    ProcessSOF0(decoder);
 }
 
 void ProcessDHT(JPEGDecoder& decoder) {
     size_t size = decoder.GetMarkerSize();
 
+    std::vector<uint8_t> code_lengths(kHuffmanSize);
+    std::vector<uint8_t> values;
+
     while (size != 0) {
         if (size < 1 + kHuffmanSize) {
             DLOG(ERROR) << "Incorrect DHT size\n";
@@ -155,23 +165,12 @@ void ProcessDHT(JPEGDecoder& decoder) {
         }
         size -= 1 + kHuffmanSize;
 
-        HuffmanTree huffman;
         MarkerType id = decoder.ReadByte();
-        std::vector<uint8_t> code_lengths;
-        std::vector<uint8_t> values;
-
-        size_t value_size = 0;
-
-        code_lengths.reserve(kHuffmanSize);
 
         DLOG(INFO) << "Build Huffman " << id << "\n";
 
-        for (size_t i = 0; i < kHuffmanSize; ++i) {
-            code_lengths.push_back(decoder.ReadByte());
-            value_size += code_lengths.back();
-        }
-
-        values.reserve(value_size);
+        decoder.ReadBytes(code_lengths.data(), kHuffmanSize);
+        size_t value_size = std::accumulate(code_lengths.begin(), code_lengths.end(), size_t(0));
 
         if (size < value_size) {
             DLOG(ERROR) << "Incorrect DHT size\n";
@@ -180,21 +179,24 @@ void ProcessDHT(JPEGDecoder& decoder) {
 
         size -= value_size;
 
-        for (size_t i = 0; i < value_size; ++i) {
-            values.push_back(decoder.ReadByte());
-        }
+        values.resize(value_size);
+        decoder.ReadBytes(values.data(), value_size);
         DLOG(INFO) << "Num of values " << values.size() << "\n";
 
-        huffman.Build(code_lengths, values);
+        const HuffmanTree* huffman = decoder.GetHuffmanTree(code_lengths, values);
 
         if (id == k00) {
-            decoder.DHTDC0 = std::move(huffman);
+            decoder.DHTDC[0] = huffman;
+            decoder.GetHeader().dc_tables[0] = true;
         } else if (id == k01) {
-            decoder.DHTDC1 = std::move(huffman);
+            decoder.DHTDC[1] = huffman;
+            decoder.GetHeader().dc_tables[1] = true;
         } else if (id == k10) {
-            decoder.DHTAC0 = std::move(huffman);
+            decoder.DHTAC[0] = huffman;
+            decoder.GetHeader().ac_tables[0] = true;
         } else if (id == k11) {
-            decoder.DHTAC1 = std::move(huffman);
+            decoder.DHTAC[1] = huffman;
+            decoder.GetHeader().ac_tables[1] = true;
         } else {
             DLOG(ERROR) << "Unknown DHT id\n";
             throw std::runtime_error("Unknown DHT id\n");
@@ -205,62 +207,69 @@ void ProcessDHT(JPEGDecoder& decoder) {
 void ProcessDQT(JPEGDecoder& decoder) {
     size_t size = decoder.GetMarkerSize();
     std::vector<int32_t> dqt(kTableSize);
-    std::function<int32_t()> reader;
+    std::array<uint8_t, 2 * kTableSize> raw;
 
     while (size != 0) {
         MarkerType id = decoder.ReadByte();
 
         if (id >> (kByteSize / 2) == 0) {
-            reader = [&]() { return static_cast<int32_t>(decoder.ReadByte()); };
-
             if (size < kTableSize + 1) {
                 DLOG(ERROR) << "Incorrect DQT size\n";
                 throw std::runtime_error("Incorrect DQT size\n");
             }
             size -= kTableSize + 1;
-        } else if (id >> (kByteSize / 2) == 1) {
-            reader = [&]() { return static_cast<int32_t>(decoder.ReadTwoBytes()); };
 
+            decoder.ReadBytes(raw.data(), kTableSize);
+            for (size_t i = 0; i < kTableSize; ++i) {
+                dqt[kZigZag[i]] = raw[i];
+            }
+        } else if (id >> (kByteSize / 2) == 1) {
             if (size < 2 * kTableSize + 1) {
                 DLOG(ERROR) << "Incorrect DQT size\n";
                 throw std::runtime_error("Incorrect DQT size\n");
             }
             size -= 2 * kTableSize + 1;
+
+            decoder.ReadBytes(raw.data(), 2 * kTableSize);
+            for (size_t i = 0; i < kTableSize; ++i) {
+                dqt[kZigZag[i]] = (static_cast<int32_t>(raw[2 * i]) << kByteSize) + raw[2 * i + 1];
+            }
         } else {
             DLOG(ERROR) << "Unknown DQT length\n";
             throw std::runtime_error("Unknown DQT length\n");
         }
 
-        for (auto index : kZigZag) {
-            dqt[index] = reader();
-        }
-
         decoder.GetTableById(id) = dqt;
+        decoder.GetHeader().quant_tables[id % 2] = true;
     }
 }
 
 void ProcessAPPn(JPEGDecoder& decoder) {
-    size_t size = decoder.GetMarkerSize();
-    for (size_t i = 0; i < size; ++i) {
-        decoder.ReadByte();
-    }
+    decoder.SkipBytes(decoder.GetMarkerSize());
 }
 
 void ProcessCOM(JPEGDecoder& decoder) {
     size_t size = decoder.GetMarkerSize();
-    std::string comment;
-
-    comment.reserve(size);
+    std::string comment(size, '\0');
 
-    for (size_t i = 0; i < size; ++i) {
-        comment += static_cast<char>(decoder.ReadByte());
-    }
+    decoder.ReadBytes(reinterpret_cast<uint8_t*>(comment.data()), size);
 
     decoder.SetComment(comment);
 }
 
+void CheckScanTables(JPEGDecoder& decoder, bool dc, bool ac) {
+    for (size_t i = 0; i < kChannelNum; ++i) {
+        const Channel& channel = decoder.GetChannelById(i);
+        if (channel.in_scan && ((dc && channel.DHTDC == nullptr) ||
+                                (ac && channel.DHTAC == nullptr))) {
+            DLOG(ERROR) << "Undefined DHT\n";
+            throw std::runtime_error("Undefined DHT\n");
+        }
+    }
+}
+
 void ProcessSOS(JPEGDecoder& decoder) {
-    if (decoder.GetImage().Height() == 0 || decoder.GetImage().Width() == 0) {
+    if (!decoder.IsSizeSet()) {
         DLOG(ERROR) << "Empty Image\n";
         throw std::runtime_error("Empty Image\n");
     }
@@ -271,52 +280,83 @@ void ProcessSOS(JPEGDecoder& decoder) {
 
     size_t size = decoder.GetMarkerSize();
     size_t channel_num = decoder.ReadByte();
+    size_t used_num = static_cast<size_t>(decoder.Y.used_) +
+                      static_cast<size_t>(decoder.Cb.used_) +
+                      static_cast<size_t>(decoder.Cr.used_);
 
-    if (size != 1 + channel_num * 2 + 3 ||
-        channel_num != static_cast<size_t>(decoder.Y.used_) +
-                           static_cast<size_t>(decoder.Cb.used_) +
-                           static_cast<size_t>(decoder.Cr.used_)) {
+    // Scans of a progressive image may contain only a part of the channels.
+    if (size != 1 + channel_num * 2 + 3 || channel_num == 0 || channel_num > used_num ||
+        (!decoder.IsProgressive() && channel_num != used_num)) {
         DLOG(ERROR) << "Error in SOS\n";
         throw std::runtime_error("Error in SOS\n");
     }
 
-    for (size_t i = 0; i < 3; ++i) {
-        if (!decoder.GetChannelById(i).used_) {
-            continue;
-        }
+    for (size_t i = 0; i < kChannelNum; ++i) {
+        decoder.GetChannelById(i).in_scan = false;
+    }
 
+    for (size_t k = 0, i = 0; k < channel_num; ++k, ++i) {
         size_t id = decoder.ReadByte();
 
-        if (id != i + 1) {
+        // Channels go in the order of ids, a progressive scan may skip used ones.
+        while (i < kChannelNum && id != i + 1 &&
+               (decoder.IsProgressive() || !decoder.GetChannelById(i).used_)) {
+            ++i;
+        }
+
+        if (i == kChannelNum || id != i + 1 || !decoder.GetChannelById(i).used_) {
             DLOG(ERROR) << "Wrong channel id\n";
             throw std::runtime_error("Wrong channel id\n");
         }
+        decoder.GetChannelById(i).in_scan = true;
 
         uint8_t table_id = decoder.ReadByte();
 
-        if ((table_id >> (kByteSize / 2)) == 0) {
-            decoder.GetChannelById(i).DHTDC = &decoder.DHTDC0;
-        } else if ((table_id >> (kByteSize / 2)) == 1) {
-            decoder.GetChannelById(i).DHTDC = &decoder.DHTDC1;
-        } else {
+        if ((table_id >> (kByteSize / 2)) >= decoder.DHTDC.size() ||
+            (table_id % (1 << (kByteSize / 2))) >= decoder.DHTAC.size()) {
             DLOG(ERROR) << "Wrong DHT num\n";
             throw std::runtime_error("Wrong DHT num\n");
         }
+        decoder.GetChannelById(i).DHTDC = decoder.DHTDC[table_id >> (kByteSize / 2)];
+        decoder.GetChannelById(i).DHTAC = decoder.DHTAC[table_id % (1 << (kByteSize / 2))];
+    }
 
-        if ((table_id % (1 << (kByteSize / 2))) == 0) {
-            decoder.GetChannelById(i).DHTAC = &decoder.DHTAC0;
-        } else if ((table_id % (1 << (kByteSize / 2))) == 1) {
-            decoder.GetChannelById(i).DHTAC = &decoder.DHTAC1;
-        } else {
-            DLOG(ERROR) << "Wrong DHT num\n";
-            throw std::runtime_error("Wrong DHT num\n");
+    ScanInfo scan;
+    scan.spectral_start = decoder.ReadByte();
+    scan.spectral_end = decoder.ReadByte();
+    uint8_t approx = decoder.ReadByte();
+    scan.approx_high = approx >> (kByteSize / 2);
+    scan.approx_low = approx % (1 << (kByteSize / 2));
+
+    if (!decoder.IsProgressive()) {
+        if (scan.spectral_start != 0 || scan.spectral_end != kTableSize - 1 || approx != 0) {
+            DLOG(ERROR) << "Wrong end of SOS meta information\n";
+            throw std::runtime_error("Wrong end of SOS meta information\n");
         }
+        CheckScanTables(decoder, true, true);
+        decoder.StartImageCreation();
+        return;
     }
 
-    if (decoder.ReadByte() != 0x00 || decoder.ReadByte() != 0x3f || decoder.ReadByte() != 0x00) {
-        DLOG(ERROR) << "Wrong end of SOS meta information\n";
-        throw std::runtime_error("Wrong end of SOS meta information\n");
+    // DC and AC coefficients are never mixed in one scan, AC scans have one channel.
+    if (scan.spectral_end >= kTableSize || scan.spectral_start > scan.spectral_end ||
+        (scan.spectral_start == 0 && scan.spectral_end != 0) ||
+        (scan.spectral_start != 0 && channel_num != 1) || scan.approx_low > 13 ||
+        (scan.approx_high != 0 && scan.approx_high != scan.approx_low + 1)) {
+        DLOG(ERROR) << "Wrong progressive scan\n";
+        throw std::runtime_error("Wrong progressive scan\n");
     }
 
-    decoder.StartImageCreation();
+    // DC refinement reads raw bits, only the first DC scan uses the DC table.
+    CheckScanTables(decoder, scan.spectral_start == 0 && scan.approx_high == 0,
+                    scan.spectral_start != 0);
+    decoder.DecodeScan(scan);
+}
+
+void ProcessDRI(JPEGDecoder& decoder) {
+    if (decoder.GetMarkerSize() != 2) {
+        DLOG(ERROR) << "Wrong DRI size\n";
+        throw std::runtime_error("Wrong DRI size\n");
+    }
+    decoder.SetRestartInterval(decoder.ReadTwoBytes());
 }
@@ -21,4 +21,6 @@ void ProcessCOM(JPEGDecoder& decoder);
 
 void ProcessSOS(JPEGDecoder& decoder);
 
-// void ProcessSOF2();  // for progressive
+void ProcessDRI(JPEGDecoder& decoder);
+
+void ProcessSOF2(JPEGDecoder& decoder);
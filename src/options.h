@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include "idct.h"
+#include "image.h"
+#include "stats.h"
+
+// Rectangle of an image in pixels.
+struct Rect {
+    size_t x = 0;
+    size_t y = 0;
+    size_t width = 0;
+    size_t height = 0;
+};
+
+struct DecodeOptions {
+    IDCTMethod idct_method = IDCTMethod::kIslow;
+    PixelFormat pixel_format = PixelFormat::kRGB8;
+    // Number of threads decoding a baseline scan: restart intervals are decoded concurrently,
+    // files without restart markers are entropy decoded on the calling thread while the other
+    // threads transform and convert the rows already read. Not used with row callbacks.
+    size_t threads = 1;
+    // 1, 2, 4 or 8, the image is decoded at 1 / scale of its size straight from the
+    // low frequency coefficients.
+    size_t scale = 1;
+    // Only this part of the scaled image is decoded and returned, the whole image if it is
+    // empty. Must lie inside the image.
+    Rect crop;
+    // If not 0, decoding of a progressive image stops after this number of scans and the
+    // image is rendered from the coefficients read so far.
+    size_t max_scans = 0;
+    // If not nullptr, receives the statistics of the decode, see DecodeStats. Each decode
+    // needs its own.
+    DecodeStats* stats = nullptr;
+};
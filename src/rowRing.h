@@ -0,0 +1,111 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+
+// Bounded ring between one producer and several consumers of consecutive items. The ring only
+// orders access to the slots, the data of item i lives in slot i % Depth() of buffers owned by
+// the caller. The producer may fill the slot of an item once the consumer of the item Depth()
+// before it has released the slot. Claiming is lock-free; publishing, releasing and closing
+// take the mutex, so no wakeup of the threads sleeping in Claim and WaitWritable is lost.
+class RowRing {
+public:
+    explicit RowRing(size_t depth)
+        : depth_(depth), free_for_(std::make_unique<std::atomic<size_t>[]>(depth)) {
+        for (size_t i = 0; i < depth_; ++i) {
+            free_for_[i].store(i, std::memory_order_relaxed);
+        }
+    }
+
+    RowRing(const RowRing&) = delete;
+    RowRing& operator=(const RowRing&) = delete;
+
+    size_t Depth() const {
+        return depth_;
+    }
+
+    // Producer: the slot of |item| may be filled.
+    bool CanWrite(size_t item) const {
+        return free_for_[item % depth_].load(std::memory_order_acquire) == item;
+    }
+
+    // Producer: sleeps until the slot of |item| may be filled.
+    void WaitWritable(size_t item) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        has_slot_.wait(lock, [this, item] { return CanWrite(item); });
+    }
+
+    // Producer: makes the next item visible to the consumers, items are published in order.
+    void Publish() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            published_.fetch_add(1, std::memory_order_release);
+        }
+        has_item_.notify_one();
+    }
+
+    // Producer: no more items will be published.
+    void Close() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            closed_.store(true, std::memory_order_release);
+        }
+        has_item_.notify_all();
+    }
+
+    // Consumer: takes the oldest published item nobody has taken, false if there is none.
+    bool TryClaim(size_t& item) {
+        size_t next = claimed_.load(std::memory_order_relaxed);
+        while (next < published_.load(std::memory_order_acquire)) {
+            if (claimed_.compare_exchange_weak(next, next + 1, std::memory_order_acquire,
+                                               std::memory_order_relaxed)) {
+                item = next;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Consumer: takes the oldest published item nobody has taken, sleeping until one is
+    // published. False once the ring is closed and all published items are taken.
+    bool Claim(size_t& item) {
+        while (!TryClaim(item)) {
+            std::unique_lock<std::mutex> lock(mutex_);
+            has_item_.wait(lock, [this] { return closed_.load() || HasUnclaimed(); });
+            if (!HasUnclaimed()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Consumer: the slot of |item| may be filled with the item Depth() after it.
+    void Release(size_t item) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            free_for_[item % depth_].store(item + depth_, std::memory_order_release);
+        }
+        has_slot_.notify_one();
+    }
+
+private:
+    size_t depth_;
+    // Item the slot may be filled with.
+    std::unique_ptr<std::atomic<size_t>[]> free_for_;
+    std::atomic<size_t> published_{0};
+    std::atomic<size_t> claimed_{0};
+    std::atomic<bool> closed_{false};
+    std::mutex mutex_;
+    // Signalled when an item is published or the ring is closed.
+    std::condition_variable has_item_;
+    // Signalled when a slot is released.
+    std::condition_variable has_slot_;
+
+    bool HasUnclaimed() const {
+        return claimed_.load(std::memory_order_acquire) <
+               published_.load(std::memory_order_acquire);
+    }
+};
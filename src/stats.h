@@ -0,0 +1,96 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include "cons.h"
+
+// Statements in JPEG_DECODER_STATS_ONLY are compiled only into builds with statistics, other
+// builds have no trace of them.
+#ifdef JPEG_DECODER_STATS
+#define JPEG_DECODER_STATS_ONLY(...) __VA_ARGS__
+#else
+#define JPEG_DECODER_STATS_ONLY(...)
+#endif
+
+// Where the time and memory of a decode went. Filled only by builds with JPEG_DECODER_STATS
+// defined, stays zero otherwise.
+struct DecodeStats {
+    // Nanoseconds spent in each stage, summed over threads. Timers are read around every
+    // block, so the stages are slower in builds with statistics.
+    uint64_t marker_ns = 0;
+    uint64_t entropy_ns = 0;
+    uint64_t idct_ns = 0;
+    uint64_t upsampling_ns = 0;
+    uint64_t color_ns = 0;
+    // Wall time of the whole decode.
+    uint64_t total_ns = 0;
+    // Bytes of the input read, including the skipped segments.
+    size_t bytes = 0;
+    // MCU and blocks entropy decoded, including the ones outside of the crop. Progressive
+    // images count them in every scan.
+    size_t mcus = 0;
+    size_t blocks = 0;
+    // Blocks transformed to samples.
+    size_t idct_blocks = 0;
+    // Blocks of baseline scans transformed by the DC-only fill and by the kernel for the
+    // top-left 4x4 coefficients, the rest take the full transform.
+    size_t dc_only_blocks = 0;
+    size_t low_frequency_blocks = 0;
+    // Blocks of baseline scans by the zigzag position of their end of block, the last entry
+    // counts blocks coded up to the last coefficient.
+    std::array<size_t, kTableSize + 1> eob_histogram{};
+    // AC coefficients of baseline scans by the run of zeros before them, ZRL counts as 15.
+    std::array<size_t, kHuffmanSize> zero_run_histogram{};
+    // Largest size of the planes, coefficients and other buffers of the decoder.
+    size_t peak_scratch_bytes = 0;
+
+    void Merge(const DecodeStats& other) {
+        marker_ns += other.marker_ns;
+        entropy_ns += other.entropy_ns;
+        idct_ns += other.idct_ns;
+        upsampling_ns += other.upsampling_ns;
+        color_ns += other.color_ns;
+        total_ns += other.total_ns;
+        bytes += other.bytes;
+        mcus += other.mcus;
+        blocks += other.blocks;
+        idct_blocks += other.idct_blocks;
+        dc_only_blocks += other.dc_only_blocks;
+        low_frequency_blocks += other.low_frequency_blocks;
+        for (size_t i = 0; i < eob_histogram.size(); ++i) {
+            eob_histogram[i] += other.eob_histogram[i];
+        }
+        for (size_t i = 0; i < zero_run_histogram.size(); ++i) {
+            zero_run_histogram[i] += other.zero_run_histogram[i];
+        }
+        peak_scratch_bytes = std::max(peak_scratch_bytes, other.peak_scratch_bytes);
+    }
+};
+
+// Adds the time between laps to the counters of |stats|, does nothing if it is nullptr.
+class StageClock {
+public:
+    explicit StageClock(DecodeStats* stats) : stats_(stats) {
+        if (stats_ != nullptr) {
+            last_ = std::chrono::steady_clock::now();
+        }
+    }
+
+    // Adds the time since the previous lap to |counter| of the stats.
+    void Lap(uint64_t DecodeStats::*counter) {
+        if (stats_ == nullptr) {
+            return;
+        }
+        auto now = std::chrono::steady_clock::now();
+        stats_->*counter += static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(now - last_).count());
+        last_ = now;
+    }
+
+private:
+    DecodeStats* stats_;
+    std::chrono::steady_clock::time_point last_;
+};
@@ -0,0 +1,44 @@
+#include "tableCache.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "huffman.h"
+#include "idct.h"
+
+const HuffmanTree* TableCache::GetHuffmanTree(const std::vector<uint8_t>& code_lengths,
+                                              const std::vector<uint8_t>& values) {
+    key_.assign(code_lengths.begin(), code_lengths.end());
+    key_.append(values.begin(), values.end());
+
+    auto it = huffman_.find(key_);
+    if (it != huffman_.end()) {
+        return it->second.get();
+    }
+
+    auto tree = std::make_unique<HuffmanTree>();
+    tree->Build(code_lengths, values);
+    return huffman_.emplace(key_, std::move(tree)).first->second.get();
+}
+
+const IDCTTable* TableCache::GetIDCTTable(IDCTMethod method, const std::vector<int32_t>& dqt) {
+    key_.assign(1, static_cast<char>(method));
+    key_.append(reinterpret_cast<const char*>(dqt.data()), dqt.size() * sizeof(int32_t));
+
+    auto it = idct_.find(key_);
+    if (it != idct_.end()) {
+        return it->second.get();
+    }
+
+    auto table = std::make_unique<IDCTTable>();
+    PrepareIDCTTable(method, dqt, *table);
+    return idct_.emplace(key_, std::move(table)).first->second.get();
+}
+
+void TableCache::Trim() {
+    if (huffman_.size() > kMaxSize || idct_.size() > kMaxSize) {
+        huffman_.clear();
+        idct_.clear();
+    }
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "huffman.h"
+#include "idct.h"
+
+// Huffman trees and dequantization tables built from the contents of DHT and DQT segments.
+// Images written by the same encoder share their tables, so they are built once.
+class TableCache {
+public:
+    // Maximum number of tables of each kind kept between images.
+    static constexpr size_t kMaxSize = 256;
+
+    TableCache() = default;
+
+    TableCache(const TableCache&) = delete;
+    TableCache& operator=(const TableCache&) = delete;
+
+    // Returns the tree built from DHT |code_lengths| and |values|.
+    const HuffmanTree* GetHuffmanTree(const std::vector<uint8_t>& code_lengths,
+                                      const std::vector<uint8_t>& values);
+
+    // Returns the table of |method| prepared from quantization table |dqt| in natural order.
+    const IDCTTable* GetIDCTTable(IDCTMethod method, const std::vector<int32_t>& dqt);
+
+    // Drops all tables if there are more than kMaxSize of some kind. Invalidates returned
+    // pointers.
+    void Trim();
+
+private:
+    std::unordered_map<std::string, std::unique_ptr<HuffmanTree>> huffman_;
+    std::unordered_map<std::string, std::unique_ptr<IDCTTable>> idct_;
+    // Scratch key, reused to avoid allocations.
+    std::string key_;
+};
@@ -0,0 +1,121 @@
+#include "threadPool.h"
+#include <chrono>
+#include <cstddef>
+#include <utility>
+
+namespace {
+
+thread_local const ThreadPool* current_pool = nullptr;
+thread_local size_t current_worker = 0;
+
+}  // namespace
+
+ThreadPool::ThreadPool(size_t threads) {
+    queues_.reserve(threads);
+    for (size_t i = 0; i < threads; ++i) {
+        queues_.push_back(std::make_unique<Queue>());
+    }
+    threads_.reserve(threads);
+    for (size_t i = 0; i < threads; ++i) {
+        threads_.emplace_back([this, i] { Work(i); });
+    }
+}
+
+std::future<void> ThreadPool::Submit(std::function<void()> task) {
+    std::packaged_task<void()> packaged(std::move(task));
+    std::future<void> result = packaged.get_future();
+
+    // Counted before it is queued, so the counter never drops below the number of tasks.
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++pending_;
+    }
+    size_t worker = CurrentWorker();
+    if (worker == queues_.size()) {
+        worker = next_queue_++ % queues_.size();
+    }
+    {
+        std::lock_guard<std::mutex> lock(queues_[worker]->mutex);
+        queues_[worker]->tasks.push_back(std::move(packaged));
+    }
+    has_task_.notify_one();
+    changed_.notify_all();
+    return result;
+}
+
+void ThreadPool::Wait(std::future<void>& result) {
+    size_t worker = CurrentWorker();
+    auto ready = [&result] {
+        return result.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    };
+    while (!ready()) {
+        if (RunTask(worker)) {
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(mutex_);
+        changed_.wait(lock, [&] { return pending_ != 0 || ready(); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    has_task_.notify_all();
+    for (auto& thread : threads_) {
+        thread.join();
+    }
+}
+
+size_t ThreadPool::CurrentWorker() const {
+    return current_pool == this ? current_worker : queues_.size();
+}
+
+bool ThreadPool::RunTask(size_t worker) {
+    std::packaged_task<void()> task;
+    if (worker < queues_.size()) {
+        Queue& queue = *queues_[worker];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.tasks.empty()) {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+        }
+    }
+    for (size_t i = 1; i <= queues_.size() && !task.valid(); ++i) {
+        Queue& queue = *queues_[(worker + i) % queues_.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.tasks.empty()) {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+        }
+    }
+
+    if (!task.valid()) {
+        return false;
+    }
+    --pending_;
+    task();
+    // Taking the mutex orders the notification after the predicate check of a thread about to
+    // sleep in Wait.
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+    }
+    changed_.notify_all();
+    return true;
+}
+
+void ThreadPool::Work(size_t worker) {
+    current_pool = this;
+    current_worker = worker;
+    while (true) {
+        if (RunTask(worker)) {
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(mutex_);
+        has_task_.wait(lock, [this] { return stop_ || pending_ != 0; });
+        if (stop_ && pending_ == 0) {
+            return;
+        }
+    }
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed number of threads executing submitted tasks. Each worker has its own queue: tasks
+// submitted by a worker go to its queue and are taken from the back, idle workers steal from
+// the front of the other queues. Tasks submitted from other threads are spread round-robin.
+class ThreadPool {
+public:
+    ThreadPool() = delete;
+
+    explicit ThreadPool(size_t threads);
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Exceptions thrown by |task| are rethrown by get() of the returned future.
+    std::future<void> Submit(std::function<void()> task);
+
+    // Runs queued tasks on the calling thread until |result| of a task of this pool is ready,
+    // so a task waiting for the tasks it submitted does not block its worker. Sleeps while
+    // there is nothing to run.
+    void Wait(std::future<void>& result);
+
+    // Finishes all submitted tasks before joining the threads.
+    ~ThreadPool();
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<std::packaged_task<void()>> tasks;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues_;
+    std::vector<std::thread> threads_;
+    // Number of tasks in all queues.
+    std::atomic<size_t> pending_{0};
+    std::atomic<size_t> next_queue_{0};
+    std::mutex mutex_;
+    std::condition_variable has_task_;
+    // Signalled when a task is queued or finished, wakes the threads sleeping in Wait.
+    std::condition_variable changed_;
+    bool stop_ = false;
+
+    // Index of the worker running the calling thread, queues_.size() for other threads.
+    size_t CurrentWorker() const;
+
+    // Runs one task from the queue of |worker| or stolen from the others, returns false if
+    // there are none.
+    bool RunTask(size_t worker);
+
+    void Work(size_t worker);
+};
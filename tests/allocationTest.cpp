@@ -0,0 +1,80 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <vector>
+#include "decoder.h"
+#include "image.h"
+#include "syntheticJPEG.h"
+
+namespace {
+
+std::atomic<size_t> allocation_count{0};
+
+std::vector<uint8_t> EncodeImage(size_t size, size_t components, size_t subsampling,
+                                 size_t restart_interval) {
+    SyntheticImage image;
+    image.width = size;
+    image.height = size;
+    image.components = components;
+    image.horizontal = static_cast<uint8_t>(subsampling);
+    image.vertical = static_cast<uint8_t>(subsampling);
+    image.restart_interval = restart_interval;
+    return EncodeSyntheticJPEG(image);
+}
+
+// Number of allocations made by decoding |data| with |context|.
+size_t CountAllocations(DecoderContext& context, const std::vector<uint8_t>& data,
+                        const DecodeOptions& options) {
+    size_t before = allocation_count.load();
+    Image image = context.Decode(data.data(), data.size(), options);
+    return allocation_count.load() - before;
+}
+
+}  // namespace
+
+void* operator new(size_t size) {
+    ++allocation_count;
+    void* pointer = std::malloc(size != 0 ? size : 1);
+    if (pointer == nullptr) {
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+
+void operator delete(void* pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept {
+    std::free(pointer);
+}
+
+// Once the scratch buffers of the context have grown to a large image, the number of
+// allocations is fixed per image and does not grow with the number of MCUs.
+TEST(AllocationTest, CountDoesNotDependOnImageSize) {
+    // Restart intervals are decoded as separate tasks, files without them are pipelined.
+    for (size_t restart_interval : {0, 4}) {
+        for (size_t threads : {1, 2}) {
+            for (size_t components : {1, 3}) {
+                for (size_t subsampling : {1, 2}) {
+                    std::vector<uint8_t> small =
+                        EncodeImage(64, components, subsampling, restart_interval);
+                    std::vector<uint8_t> large =
+                        EncodeImage(1024, components, subsampling, restart_interval);
+                    DecodeOptions options;
+                    options.threads = threads;
+
+                    DecoderContext context;
+                    context.Decode(large.data(), large.size(), options);
+                    EXPECT_EQ(CountAllocations(context, small, options),
+                              CountAllocations(context, large, options))
+                        << "restart interval " << restart_interval << " threads " << threads
+                        << " components " << components << " subsampling " << subsampling;
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,44 @@
+#include <gtest/gtest.h>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "decoder.h"
+#include "image.h"
+#include "options.h"
+#include "syntheticJPEG.h"
+#include "testImages.h"
+
+// A cropped decode skips the MCU outside the window, the pixels inside must equal the same
+// rectangle of the full decode at the same scale.
+TEST(CropTest, MatchesRectangleOfFullDecode) {
+    for (bool progressive : {false, true}) {
+        for (size_t restart_interval : {0, 5}) {
+            SyntheticImage image;
+            image.width = 330;
+            image.height = 250;
+            image.restart_interval = restart_interval;
+            image.progressive = progressive;
+            std::vector<uint8_t> data = EncodeSyntheticJPEG(image);
+
+            for (size_t scale : {1, 2}) {
+                for (size_t threads : {1, 4}) {
+                    DecodeOptions options;
+                    options.scale = scale;
+                    options.threads = threads;
+                    Image full = Decode(data.data(), data.size(), options);
+
+                    // Windows starting inside an MCU, inside a single MCU and at the corner.
+                    for (Rect crop : {Rect{21, 13, 97, 61}, Rect{5, 70, 9, 7},
+                                      Rect{full.Width() - 30, full.Height() - 18, 30, 18}}) {
+                        options.crop = crop;
+                        EXPECT_TRUE(SameImage(CropImage(full, crop),
+                                              Decode(data.data(), data.size(), options)))
+                            << "progressive " << progressive << " restart interval "
+                            << restart_interval << " scale " << scale << " threads " << threads
+                            << " crop " << crop.x << "," << crop.y;
+                    }
+                }
+            }
+        }
+    }
+}
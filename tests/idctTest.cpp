@@ -0,0 +1,107 @@
+#include <gtest/gtest.h>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+#include "cons.h"
+#include "idct.h"
+
+#ifdef JPEG_DECODER_SSE2
+
+namespace {
+
+constexpr size_t kSize = kStandartMCUSize;
+
+// Quantized coefficients of a random block of samples, as an 8-bit encoder produces them,
+// and a random quantization table. With |saturate| the samples are 0 or 255 and the table is
+// coarse, so the reconstruction overshoots and clamps. With |low| only the top-left 4x4
+// coefficients are kept.
+void MakeBlock(std::mt19937& rng, bool saturate, bool low, IDCTTable& table,
+               std::array<int16_t, kTableSize>& coef) {
+    std::vector<int32_t> dqt(kTableSize);
+    for (auto& value : dqt) {
+        value = 1 + static_cast<int32_t>(rng() % (saturate ? 255 : 64));
+    }
+    PrepareIDCTTable(IDCTMethod::kIslow, dqt, table);
+
+    std::array<double, kTableSize> samples;
+    for (auto& sample : samples) {
+        sample = (saturate ? (rng() % 2) * 255.0 : static_cast<double>(rng() % 256)) - 128;
+    }
+    for (size_t u = 0; u < kSize; ++u) {
+        for (size_t v = 0; v < kSize; ++v) {
+            double sum = 0;
+            for (size_t y = 0; y < kSize; ++y) {
+                for (size_t x = 0; x < kSize; ++x) {
+                    sum += samples[y * kSize + x] * std::cos((2 * y + 1) * u * M_PI / 16) *
+                           std::cos((2 * x + 1) * v * M_PI / 16);
+                }
+            }
+            double scale = (u == 0 ? M_SQRT1_2 : 1) * (v == 0 ? M_SQRT1_2 : 1) / 4;
+            size_t i = u * kSize + v;
+            bool dropped = low && (u >= 4 || v >= 4);
+            coef[i] = dropped ? 0 : static_cast<int16_t>(std::lround(sum * scale / dqt[i]));
+        }
+    }
+}
+
+// Random coefficients whose dequantized values do not fit into 16 bits. With |sixteen_bit|
+// the table is a 16-bit DQT with values past 32767 and the coefficients are -1, 0 or 1, so
+// only the table tells the block apart. Otherwise the table is 8-bit and the first product
+// overflows. With |low| only the top-left 4x4 coefficients are kept.
+void MakeWideBlock(std::mt19937& rng, bool sixteen_bit, bool low, IDCTTable& table,
+                   std::array<int16_t, kTableSize>& coef) {
+    std::vector<int32_t> dqt(kTableSize);
+    for (size_t i = 0; i < kTableSize; ++i) {
+        dqt[i] = 1 + static_cast<int32_t>(rng() % (sixteen_bit ? 65535 : 255));
+        int32_t range = sixteen_bit ? 1 : 2047;
+        int32_t value = static_cast<int32_t>(rng() % (2 * range + 1)) - range;
+        bool dropped = (low && (i / kSize >= 4 || i % kSize >= 4)) || rng() % 4 != 0;
+        coef[i] = dropped ? 0 : static_cast<int16_t>(value);
+    }
+    dqt[0] = sixteen_bit ? 65535 : 255;
+    coef[0] = static_cast<int16_t>((rng() % 2 == 0 ? 1 : -1) * (sixteen_bit ? 1 : 2047));
+    PrepareIDCTTable(IDCTMethod::kIslow, dqt, table);
+}
+
+void ExpectSame(IDCTFunction scalar, IDCTFunction simd, bool low, bool wide = false) {
+    std::mt19937 rng(42);
+    constexpr size_t kStride = kSize + 5;
+    for (int i = 0; i < 5000; ++i) {
+        IDCTTable table;
+        std::array<int16_t, kTableSize> coef;
+        if (wide) {
+            MakeWideBlock(rng, i % 2 == 0, low, table, coef);
+        } else {
+            MakeBlock(rng, i % 4 == 0, low, table, coef);
+        }
+        std::array<uint8_t, kSize * kStride> expected{};
+        std::array<uint8_t, kSize * kStride> actual{};
+        scalar(coef.data(), table, expected.data(), kStride);
+        simd(coef.data(), table, actual.data(), kStride);
+        ASSERT_EQ(expected, actual) << "block " << i;
+    }
+}
+
+}  // namespace
+
+TEST(IDCTTest, IslowSSE2MatchesScalar) {
+    ExpectSame(IDCTIslow, IDCTIslowSSE2, false);
+}
+
+TEST(IDCTTest, IslowLowSSE2MatchesScalar) {
+    ExpectSame(IDCTIslowLow, IDCTIslowLowSSE2, true);
+}
+
+TEST(IDCTTest, IslowLowSSE2MatchesFullTransform) {
+    ExpectSame(IDCTIslow, IDCTIslowLowSSE2, true);
+}
+
+// 16-bit tables and products past 16 bits do not fit into the lanes of the SIMD kernels.
+TEST(IDCTTest, IslowSSE2MatchesScalarPast16Bits) {
+    ExpectSame(IDCTIslow, IDCTIslowSSE2, false, true);
+    ExpectSame(IDCTIslowLow, IDCTIslowLowSSE2, true, true);
+}
+
+#endif
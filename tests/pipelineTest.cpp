@@ -0,0 +1,40 @@
+#include <gtest/gtest.h>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "decoder.h"
+#include "image.h"
+#include "options.h"
+#include "syntheticJPEG.h"
+#include "testImages.h"
+
+// Files without restart markers are decoded by the pipeline when threads > 1: the calling
+// thread reads the rows of MCU and the others transform and convert them. It must not change
+// the pixels, with or without a crop window.
+TEST(PipelineTest, MatchesSingleThreadedDecode) {
+    for (size_t components : {1, 3}) {
+        for (uint8_t subsampling : {1, 2}) {
+            SyntheticImage image;
+            image.width = 301;
+            image.height = 263;
+            image.components = components;
+            image.horizontal = subsampling;
+            image.vertical = subsampling;
+            std::vector<uint8_t> data = EncodeSyntheticJPEG(image);
+
+            // The whole image, a window starting inside an MCU and one at the bottom right
+            // corner.
+            for (Rect crop : {Rect{}, Rect{37, 45, 150, 170}, Rect{250, 200, 51, 63}}) {
+                DecodeOptions options;
+                options.crop = crop;
+                Image expected = Decode(data.data(), data.size(), options);
+                for (size_t threads : {2, 4}) {
+                    options.threads = threads;
+                    EXPECT_TRUE(SameImage(expected, Decode(data.data(), data.size(), options)))
+                        << "components " << components << " subsampling " << int(subsampling)
+                        << " crop " << crop.x << "," << crop.y << " threads " << threads;
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,61 @@
+#include <gtest/gtest.h>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "decoder.h"
+#include "image.h"
+#include "syntheticJPEG.h"
+#include "testImages.h"
+
+namespace {
+
+// Image whose size is not a multiple of the MCU, so the scans of single channels cover fewer
+// blocks than the interleaved ones.
+SyntheticImage MakeImage(size_t components, uint8_t subsampling, size_t restart_interval) {
+    SyntheticImage image;
+    image.width = 203;
+    image.height = 117;
+    image.quality = 75;
+    image.components = components;
+    image.horizontal = subsampling;
+    image.vertical = subsampling;
+    image.restart_interval = restart_interval;
+    return image;
+}
+
+}  // namespace
+
+// Progressive scans carry the same quantized coefficients as the baseline scan, so both decode
+// to the same pixels.
+TEST(ProgressiveTest, MatchesBaselineDecode) {
+    for (size_t components : {1, 3}) {
+        for (uint8_t subsampling : {1, 2}) {
+            for (size_t restart_interval : {0, 5}) {
+                SyntheticImage image = MakeImage(components, subsampling, restart_interval);
+                std::vector<uint8_t> baseline = EncodeSyntheticJPEG(image);
+                image.progressive = true;
+                std::vector<uint8_t> progressive = EncodeSyntheticJPEG(image);
+
+                EXPECT_TRUE(SameImage(Decode(baseline.data(), baseline.size()),
+                                      Decode(progressive.data(), progressive.size())))
+                    << "components " << components << " subsampling " << int(subsampling)
+                    << " restart interval " << restart_interval;
+            }
+        }
+    }
+}
+
+TEST(ProgressiveTest, MaxScansRendersFullSizeImage) {
+    SyntheticImage image = MakeImage(3, 2, 0);
+    image.progressive = true;
+    std::vector<uint8_t> data = EncodeSyntheticJPEG(image);
+    Image full = Decode(data.data(), data.size());
+
+    DecodeOptions options;
+    options.max_scans = 1;
+    Image first = Decode(data.data(), data.size(), options);
+    ASSERT_EQ(first.Width(), image.width);
+    ASSERT_EQ(first.Height(), image.height);
+    // Only the halved DC coefficients are known after the first scan.
+    EXPECT_FALSE(SameImage(full, first));
+}
@@ -0,0 +1,38 @@
+#include <gtest/gtest.h>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "decoder.h"
+#include "image.h"
+#include "syntheticJPEG.h"
+#include "testImages.h"
+
+// Restart markers only reset the DC predictors, so files with and without them decode to the
+// same pixels, sequentially and with intervals decoded in parallel.
+TEST(RestartTest, MatchesDecodeWithoutRestarts) {
+    for (size_t components : {1, 3}) {
+        for (uint8_t subsampling : {1, 2}) {
+            SyntheticImage image;
+            image.width = 250;
+            image.height = 130;
+            image.components = components;
+            image.horizontal = subsampling;
+            image.vertical = subsampling;
+            std::vector<uint8_t> plain = EncodeSyntheticJPEG(image);
+            Image expected = Decode(plain.data(), plain.size());
+
+            // Intervals of 3 and 7 MCU do not divide the rows of 16 or 32 MCU.
+            for (size_t restart_interval : {1, 3, 7}) {
+                image.restart_interval = restart_interval;
+                std::vector<uint8_t> data = EncodeSyntheticJPEG(image);
+                for (size_t threads : {1, 4}) {
+                    DecodeOptions options;
+                    options.threads = threads;
+                    EXPECT_TRUE(SameImage(expected, Decode(data.data(), data.size(), options)))
+                        << "components " << components << " subsampling " << int(subsampling)
+                        << " restart interval " << restart_interval << " threads " << threads;
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,62 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "decoder.h"
+#include "header.h"
+#include "image.h"
+#include "syntheticJPEG.h"
+
+namespace {
+
+// Mean absolute difference of the channels of |scaled| from the averages of the |scale| x
+// |scale| squares of |full| it covers.
+double BoxDownscaleError(const Image& full, const Image& scaled, size_t scale) {
+    double error = 0;
+    for (size_t y = 0; y < scaled.Height(); ++y) {
+        for (size_t x = 0; x < scaled.Width(); ++x) {
+            double r = 0;
+            double g = 0;
+            double b = 0;
+            for (size_t i = 0; i < scale; ++i) {
+                for (size_t j = 0; j < scale; ++j) {
+                    RGB pixel = full.GetPixel(y * scale + i, x * scale + j);
+                    r += pixel.r;
+                    g += pixel.g;
+                    b += pixel.b;
+                }
+            }
+            double area = static_cast<double>(scale * scale);
+            RGB pixel = scaled.GetPixel(y, x);
+            error += std::abs(pixel.r - r / area) + std::abs(pixel.g - g / area) +
+                     std::abs(pixel.b - b / area);
+        }
+    }
+    return error / static_cast<double>(scaled.Width() * scaled.Height() * 3);
+}
+
+}  // namespace
+
+TEST(ScaleTest, MatchesBoxDownscaledFullDecode) {
+    for (Sampling sampling : {Sampling{1, 1}, Sampling{2, 1}, Sampling{1, 2}, Sampling{2, 2}}) {
+        SyntheticImage image;
+        image.width = 256;
+        image.height = 192;
+        image.horizontal = sampling.horizontal;
+        image.vertical = sampling.vertical;
+        std::vector<uint8_t> data = EncodeSyntheticJPEG(image);
+        Image full = Decode(data.data(), data.size());
+
+        for (size_t scale : {2, 4, 8}) {
+            DecodeOptions options;
+            options.scale = scale;
+            Image scaled = Decode(data.data(), data.size(), options);
+            ASSERT_EQ(scaled.Width(), image.width / scale);
+            ASSERT_EQ(scaled.Height(), image.height / scale);
+            EXPECT_LT(BoxDownscaleError(full, scaled, scale), 0.75)
+                << "sampling " << int(sampling.horizontal) << "x" << int(sampling.vertical)
+                << " scale " << scale;
+        }
+    }
+}
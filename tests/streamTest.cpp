@@ -0,0 +1,81 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "decoder.h"
+#include "image.h"
+#include "syntheticJPEG.h"
+#include "testImages.h"
+
+namespace {
+
+struct FeedResult {
+    Image image;
+    // Statuses other than kNeedMoreInput, repeated kRowsReady collapsed into one.
+    std::vector<FeedStatus> statuses;
+};
+
+// Feeds |data| to a StreamDecoder |chunk| bytes at a time, draining the decoder after every
+// status that may leave unused input.
+FeedResult FeedInChunks(const std::vector<uint8_t>& data, size_t chunk) {
+    FeedResult result;
+    StreamDecoder decoder;
+    size_t position = 0;
+    size_t rows = 0;
+    FeedStatus status = FeedStatus::kNeedMoreInput;
+    while (status != FeedStatus::kDone) {
+        if (status == FeedStatus::kNeedMoreInput) {
+            if (position == data.size()) {
+                ADD_FAILURE() << "decoder needs input after the end of the file";
+                return result;
+            }
+            size_t size = std::min(chunk, data.size() - position);
+            status = decoder.Feed(data.data() + position, size);
+            position += size;
+        } else {
+            status = decoder.Feed(nullptr, 0);
+        }
+
+        EXPECT_GE(decoder.RowsReady(), rows);
+        rows = decoder.RowsReady();
+        if (status != FeedStatus::kNeedMoreInput &&
+            (result.statuses.empty() || result.statuses.back() != status ||
+             status != FeedStatus::kRowsReady)) {
+            result.statuses.push_back(status);
+        }
+    }
+    EXPECT_EQ(decoder.RowsReady(), decoder.GetHeader().height);
+    result.image = decoder.TakeImage();
+    return result;
+}
+
+}  // namespace
+
+TEST(StreamTest, ChunkedFeedMatchesDecode) {
+    for (bool progressive : {false, true}) {
+        for (size_t restart_interval : {0, 7}) {
+            SyntheticImage image;
+            image.width = 150;
+            image.height = 90;
+            image.restart_interval = restart_interval;
+            image.progressive = progressive;
+            std::vector<uint8_t> data = EncodeSyntheticJPEG(image);
+            Image expected = Decode(data.data(), data.size());
+
+            for (size_t chunk : std::vector<size_t>{1, 7, 333, data.size()}) {
+                FeedResult result = FeedInChunks(data, chunk);
+                // Progressive images are converted at the end, but their rows are reported
+                // before kDone as well.
+                std::vector<FeedStatus> statuses = {
+                    FeedStatus::kHeaderReady, FeedStatus::kRowsReady, FeedStatus::kDone};
+                EXPECT_EQ(result.statuses, statuses)
+                    << "progressive " << progressive << " restart interval " << restart_interval
+                    << " chunk " << chunk;
+                EXPECT_TRUE(SameImage(expected, result.image))
+                    << "progressive " << progressive << " restart interval " << restart_interval
+                    << " chunk " << chunk;
+            }
+        }
+    }
+}
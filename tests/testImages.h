@@ -0,0 +1,35 @@
+#pragma once
+
+#include <gtest/gtest.h>
+#include <cstddef>
+#include <cstring>
+#include "image.h"
+#include "options.h"
+
+// Succeeds if |actual| has the size, format and pixels of |expected|, otherwise names the
+// first row that differs.
+inline ::testing::AssertionResult SameImage(const Image& expected, const Image& actual) {
+    if (expected.Width() != actual.Width() || expected.Height() != actual.Height() ||
+        expected.Format() != actual.Format()) {
+        return ::testing::AssertionFailure()
+               << "size " << actual.Width() << "x" << actual.Height() << " instead of "
+               << expected.Width() << "x" << expected.Height();
+    }
+    size_t row_size = expected.Width() * BytesPerPixel(expected.Format());
+    for (size_t y = 0; y < expected.Height(); ++y) {
+        if (std::memcmp(expected.Row(y), actual.Row(y), row_size) != 0) {
+            return ::testing::AssertionFailure() << "row " << y << " differs";
+        }
+    }
+    return ::testing::AssertionSuccess();
+}
+
+// Copies |rect| of |image|, as a decode cropped to it should return.
+inline Image CropImage(const Image& image, const Rect& rect) {
+    Image crop(rect.width, rect.height, image.Format());
+    size_t pixel = BytesPerPixel(image.Format());
+    for (size_t y = 0; y < rect.height; ++y) {
+        std::memcpy(crop.Row(y), image.Row(rect.y + y) + rect.x * pixel, rect.width * pixel);
+    }
+    return crop;
+}